@@ -0,0 +1,1031 @@
+#include "./acceptance_index.h"
+
+#include <cstring>
+#include <limits>
+
+namespace fsv::detail {
+	namespace {
+		auto table_mask(const char_class& table, const char* block, std::size_t n) noexcept -> std::uint64_t {
+			const auto& words = table.table();
+			auto bits = std::uint64_t{0};
+			for (std::size_t i = 0; i < n; ++i) {
+				const auto byte = static_cast<unsigned char>(block[i]);
+				bits |= ((words[byte >> 6U] >> (byte & 63U)) & 1U) << i;
+			}
+			return bits;
+		}
+	} // namespace
+
+	conjunction::conjunction(std::vector<filter> leaves) noexcept
+	: leaf_filters(std::move(leaves)) {}
+	auto conjunction::operator()(const char& c) const -> bool {
+		return std::all_of(leaf_filters.begin(), leaf_filters.end(), [&c](const filter& leaf) {
+			return leaf(c);
+		});
+	}
+	auto conjunction::mask(const char* block, std::size_t n) const -> std::uint64_t {
+		auto bits = low_bits(n);
+		for (auto leaf = leaf_filters.begin(); leaf != leaf_filters.end() and bits != 0; ++leaf) {
+			bits = mask_of(*leaf, block, n, bits);
+		}
+		return bits;
+	}
+	auto conjunction::leaves() const noexcept -> const std::vector<filter>& {
+		return leaf_filters;
+	}
+	auto mask_of(const filter& pred, const char* block, std::size_t n, std::uint64_t candidates) -> std::uint64_t {
+		if (const auto* table = pred.target<char_class>()) {
+			return table_mask(*table, block, n) & candidates;
+		}
+		if (const auto* blocks = pred.target<block_filter>()) {
+			return blocks->mask(block, n) & candidates;
+		}
+		if (const auto* conjoined = pred.target<conjunction>()) {
+			return conjoined->mask(block, n) & candidates;
+		}
+		auto bits = candidates;
+		for (auto rest = candidates; rest != 0; rest &= rest - 1) {
+			const auto i = static_cast<unsigned>(std::countr_zero(rest));
+			if (not pred(block[i])) {
+				bits &= ~(std::uint64_t{1} << i);
+			}
+		}
+		return bits;
+	}
+
+	scanner::scanner(const filter& pred) noexcept
+	: pred(&pred)
+	, table(pred.target<char_class>())
+	, blocks(pred.target<block_filter>())
+	, conjoined(pred.target<conjunction>()) {}
+	auto scanner::mask(const char* block, std::size_t n) const -> std::uint64_t {
+		auto bits = std::uint64_t{0};
+		if (blocks != nullptr) {
+			bits = blocks->mask(block, n) & low_bits(n);
+		}
+		else if (conjoined != nullptr) {
+			bits = conjoined->mask(block, n);
+		}
+		else if (table != nullptr) {
+			bits = table_mask(*table, block, n);
+		}
+		else {
+			for (std::size_t i = 0; i < n; ++i) {
+				bits |= std::uint64_t{(*pred)(block[i])} << i;
+			}
+		}
+		return bits;
+	}
+
+	namespace {
+		auto ceil_div(std::size_t n, std::size_t d) noexcept -> std::size_t {
+			return (n + d - 1) / d;
+		}
+
+		// Saved indexes are a header followed by each chunk's header and arrays. Every array is
+		// padded to eight bytes, so that a mapped index can be read in place.
+		struct image_header {
+			std::uint64_t raw_length;
+			std::uint64_t accepted;
+			std::uint64_t chunk_count;
+		};
+		struct chunk_header {
+			std::uint32_t kind;
+			std::uint32_t word_count;
+			std::uint64_t count;
+			std::uint64_t bits;
+			std::uint64_t ranks;
+			std::uint64_t starts;
+			std::uint64_t lasts;
+		};
+		auto padded(std::size_t bytes) noexcept -> std::size_t {
+			return ceil_div(bytes, 8) * 8;
+		}
+		auto write_bytes(std::ostream& out, const void* data, std::size_t size) -> void {
+			static constexpr char padding[8] = {};
+			out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+			out.write(padding, static_cast<std::streamsize>(padded(size) - size));
+		}
+		template<typename T>
+		auto read_struct(std::span<const std::byte> image, std::size_t& position) -> std::optional<T> {
+			if (sizeof(T) > image.size() - position) {
+				return std::nullopt;
+			}
+			auto value = T();
+			std::memcpy(&value, image.data() + position, sizeof(T));
+			position += padded(sizeof(T));
+			return value;
+		}
+		template<typename T>
+		auto read_array(std::span<const std::byte> image, std::size_t& position, std::uint64_t n)
+		    -> std::optional<std::span<const T>> {
+			if (n > image.size() or padded(n * sizeof(T)) > image.size() - position) {
+				return std::nullopt;
+			}
+			const auto values = std::span<const T>(reinterpret_cast<const T*>(image.data() + position), n);
+			position += padded(values.size_bytes());
+			return values;
+		}
+
+		// Rank, select and word_at over a chunk's bitmap, given how many bytes are accepted before
+		// each superblock. Packed bitmaps and the chunk extend() is still filling share them.
+		auto bitmap_rank(std::span<const std::uint64_t> bits,
+		                 std::span<const std::uint32_t> ranks,
+		                 std::size_t offset) noexcept -> std::size_t {
+			const auto word = offset / block_size;
+			const auto superblock = word / acceptance_index::words_per_superblock;
+			auto before = std::size_t{ranks[superblock]};
+			for (auto w = superblock * acceptance_index::words_per_superblock; w < word; ++w) {
+				before += popcount(bits[w]);
+			}
+			return before + popcount(bits[word] & low_bits(offset % block_size));
+		}
+		auto bitmap_select(std::span<const std::uint64_t> bits,
+		                   std::span<const std::uint32_t> ranks,
+		                   std::size_t k) noexcept -> std::size_t {
+			const auto superblock = static_cast<std::size_t>(
+			    std::distance(ranks.begin(), std::upper_bound(ranks.begin(), ranks.end(), k)) - 1);
+			auto remaining = k - ranks[superblock];
+			auto w = superblock * acceptance_index::words_per_superblock;
+			for (; popcount(bits[w]) <= remaining; ++w) {
+				remaining -= popcount(bits[w]);
+			}
+			return w * block_size + select_bit(bits[w], remaining);
+		}
+		auto bitmap_word_at(std::span<const std::uint64_t> bits, std::size_t offset) noexcept -> std::uint64_t {
+			const auto word = offset / block_size;
+			const auto shift = offset % block_size;
+			if (word >= bits.size()) {
+				return 0;
+			}
+			auto result = bits[word] >> shift;
+			if (shift != 0 and word + 1 < bits.size()) {
+				result |= bits[word + 1] << (block_size - shift);
+			}
+			return result;
+		}
+	} // namespace
+
+	acceptance_index::container::container(std::span<const std::uint64_t> words, std::size_t rank_base)
+	: representation(index_kind::bitmap)
+	, base(rank_base)
+	, accepted(0)
+	, word_count(words.size())
+	, bits()
+	, ranks()
+	, starts()
+	, lasts()
+	, owned_bits()
+	, owned_ranks()
+	, owned_starts()
+	, owned_lasts() {
+		auto runs = std::size_t{0};
+		auto carry = std::uint64_t{0};
+		for (const auto word : words) {
+			accepted += popcount(word);
+			runs += popcount(word & ~((word << 1U) | carry));
+			carry = word >> (block_size - 1);
+		}
+		// The compact containers are only worth their logarithmic rank and select when they are
+		// less than half the size of the bitmap.
+		const auto bitmap_bytes = words.size() * sizeof(std::uint64_t)
+		                          + (words.size() / words_per_superblock + 1) * sizeof(std::uint32_t);
+		const auto offsets_bytes = accepted * sizeof(std::uint16_t);
+		const auto runs_bytes = runs * (2 * sizeof(std::uint16_t) + sizeof(std::uint32_t));
+		if (2 * std::min(offsets_bytes, runs_bytes) >= bitmap_bytes) {
+			owned_bits.assign(words.begin(), words.end());
+			owned_ranks.resize(ceil_div(words.size(), words_per_superblock) + 1);
+			auto before = std::uint32_t{0};
+			for (std::size_t w = 0; w < words.size(); ++w) {
+				if (w % words_per_superblock == 0) {
+					owned_ranks[w / words_per_superblock] = before;
+				}
+				before += static_cast<std::uint32_t>(popcount(words[w]));
+			}
+			owned_ranks.back() = before;
+			use_owned();
+			return;
+		}
+		representation = offsets_bytes <= runs_bytes ? index_kind::offsets : index_kind::runs;
+		owned_starts.reserve(representation == index_kind::offsets ? accepted : runs);
+		auto before = std::uint32_t{0};
+		for (std::size_t w = 0; w < words.size(); ++w) {
+			for (auto word = words[w]; word != 0; word &= word - 1) {
+				const auto offset = static_cast<std::uint16_t>(w * block_size + select_bit(word, 0));
+				if (representation == index_kind::offsets) {
+					owned_starts.push_back(offset);
+				}
+				else if (owned_lasts.empty() or owned_lasts.back() + 1 != offset) {
+					owned_starts.push_back(offset);
+					owned_lasts.push_back(offset);
+					owned_ranks.push_back(before);
+				}
+				else {
+					owned_lasts.back() = offset;
+				}
+				++before;
+			}
+		}
+		use_owned();
+	}
+	acceptance_index::container::container(std::vector<std::uint16_t> offsets,
+	                                       std::size_t word_count,
+	                                       std::size_t rank_base)
+	: representation(index_kind::offsets)
+	, base(rank_base)
+	, accepted(offsets.size())
+	, word_count(word_count)
+	, bits()
+	, ranks()
+	, starts()
+	, lasts()
+	, owned_bits()
+	, owned_ranks()
+	, owned_starts(std::move(offsets))
+	, owned_lasts() {
+		use_owned();
+	}
+	acceptance_index::container::container(index_kind kind,
+	                                       std::size_t word_count,
+	                                       std::size_t rank_base,
+	                                       std::size_t count,
+	                                       std::span<const std::uint64_t> bits,
+	                                       std::span<const std::uint32_t> ranks,
+	                                       std::span<const std::uint16_t> starts,
+	                                       std::span<const std::uint16_t> lasts) noexcept
+	: representation(kind)
+	, base(rank_base)
+	, accepted(count)
+	, word_count(word_count)
+	, bits(bits)
+	, ranks(ranks)
+	, starts(starts)
+	, lasts(lasts)
+	, owned_bits()
+	, owned_ranks()
+	, owned_starts()
+	, owned_lasts() {}
+	// Moving a vector keeps its elements where they are, so the spans stay valid when a container
+	// is moved.
+	auto acceptance_index::container::use_owned() noexcept -> void {
+		bits = owned_bits;
+		ranks = owned_ranks;
+		starts = owned_starts;
+		lasts = owned_lasts;
+	}
+	auto acceptance_index::container::kind() const noexcept -> index_kind {
+		return representation;
+	}
+	auto acceptance_index::container::bytes() const noexcept -> std::size_t {
+		return bits.size_bytes() + ranks.size_bytes() + starts.size_bytes() + lasts.size_bytes();
+	}
+	auto acceptance_index::container::count() const noexcept -> std::size_t {
+		return accepted;
+	}
+	auto acceptance_index::container::rank_base() const noexcept -> std::size_t {
+		return base;
+	}
+	auto acceptance_index::container::rank(std::size_t offset) const noexcept -> std::size_t {
+		if (representation == index_kind::offsets) {
+			return static_cast<std::size_t>(
+			    std::distance(starts.begin(), std::lower_bound(starts.begin(), starts.end(), offset)));
+		}
+		if (representation == index_kind::runs) {
+			const auto run = std::distance(starts.begin(), std::lower_bound(starts.begin(), starts.end(), offset));
+			if (run == 0) {
+				return 0;
+			}
+			const auto i = static_cast<std::size_t>(run - 1);
+			return ranks[i] + std::min<std::size_t>(offset, std::size_t{lasts[i]} + 1) - starts[i];
+		}
+		if (offset / block_size >= word_count) {
+			return accepted;
+		}
+		return bitmap_rank(bits, ranks, offset);
+	}
+	auto acceptance_index::container::select(std::size_t k) const noexcept -> std::size_t {
+		if (representation == index_kind::offsets) {
+			return starts[k];
+		}
+		if (representation == index_kind::runs) {
+			const auto i = static_cast<std::size_t>(
+			    std::distance(ranks.begin(), std::upper_bound(ranks.begin(), ranks.end(), k)) - 1);
+			return starts[i] + (k - ranks[i]);
+		}
+		return bitmap_select(bits, ranks, k);
+	}
+	auto acceptance_index::container::contains(std::size_t offset) const noexcept -> bool {
+		return rank(offset + 1) != rank(offset);
+	}
+	auto acceptance_index::container::word_at(std::size_t offset) const noexcept -> std::uint64_t {
+		auto result = std::uint64_t{0};
+		if (representation == index_kind::offsets) {
+			for (auto it = std::lower_bound(starts.begin(), starts.end(), offset);
+			     it != starts.end() and *it < offset + block_size;
+			     ++it)
+			{
+				result |= std::uint64_t{1} << (*it - offset);
+			}
+			return result;
+		}
+		if (representation == index_kind::runs) {
+			auto i = static_cast<std::size_t>(
+			    std::distance(starts.begin(), std::upper_bound(starts.begin(), starts.end(), offset)));
+			if (i > 0 and lasts[i - 1] >= offset) {
+				--i;
+			}
+			for (; i < starts.size() and starts[i] < offset + block_size; ++i) {
+				const auto from = std::max<std::size_t>(starts[i], offset) - offset;
+				const auto to = std::min<std::size_t>(std::size_t{lasts[i]} + 1, offset + block_size) - offset;
+				result |= low_bits(to) & ~low_bits(from);
+			}
+			return result;
+		}
+		return bitmap_word_at(bits, offset);
+	}
+	auto acceptance_index::container::offsets() const noexcept -> std::span<const std::uint16_t> {
+		return starts;
+	}
+	auto acceptance_index::container::save(std::ostream& out) const -> void {
+		const auto header = chunk_header{static_cast<std::uint32_t>(representation),
+		                                 static_cast<std::uint32_t>(word_count),
+		                                 accepted,
+		                                 bits.size(),
+		                                 ranks.size(),
+		                                 starts.size(),
+		                                 lasts.size()};
+		write_bytes(out, &header, sizeof(header));
+		write_bytes(out, bits.data(), bits.size_bytes());
+		write_bytes(out, ranks.data(), ranks.size_bytes());
+		write_bytes(out, starts.data(), starts.size_bytes());
+		write_bytes(out, lasts.data(), lasts.size_bytes());
+	}
+	// Checks that the arrays have the sizes the container's kind implies and that their contents
+	// agree with each other, since every later query trusts them to stay inside the chunk.
+	auto acceptance_index::container::load(std::span<const std::byte> image,
+	                                       std::size_t& position,
+	                                       std::size_t rank_base,
+	                                       std::size_t chunk_length) -> std::optional<container> {
+		const auto header = read_struct<chunk_header>(image, position);
+		if (not header or header->word_count != ceil_div(chunk_length, block_size)) {
+			return std::nullopt;
+		}
+		const auto bits = read_array<std::uint64_t>(image, position, header->bits);
+		const auto ranks = read_array<std::uint32_t>(image, position, header->ranks);
+		const auto starts = read_array<std::uint16_t>(image, position, header->starts);
+		const auto lasts = read_array<std::uint16_t>(image, position, header->lasts);
+		if (not bits or not ranks or not starts or not lasts) {
+			return std::nullopt;
+		}
+		const auto kind = static_cast<index_kind>(header->kind);
+		auto well_formed = false;
+		if (kind == index_kind::bitmap) {
+			well_formed = bits->size() == header->word_count
+			              and ranks->size() == ceil_div(header->word_count, words_per_superblock) + 1
+			              and ranks->back() == header->count and starts->empty() and lasts->empty();
+		}
+		else if (kind == index_kind::offsets) {
+			well_formed = starts->size() == header->count and bits->empty() and ranks->empty() and lasts->empty();
+		}
+		else if (kind == index_kind::runs) {
+			well_formed = bits->empty() and ranks->size() == starts->size() and lasts->size() == starts->size();
+		}
+		if (not well_formed) {
+			return std::nullopt;
+		}
+		auto result = std::optional<container>(std::in_place,
+		                                       kind,
+		                                       header->word_count,
+		                                       rank_base,
+		                                       header->count,
+		                                       *bits,
+		                                       *ranks,
+		                                       *starts,
+		                                       *lasts);
+		if (not result->consistent(chunk_length)) {
+			return std::nullopt;
+		}
+		return result;
+	}
+	// Bitmap ranks must be the running popcounts, with no bits past the chunk; offsets must be
+	// increasing and inside the chunk; runs must be ordered, disjoint and inside the chunk, each
+	// ranked by the lengths of the runs before it. The count must match in every case.
+	auto acceptance_index::container::consistent(std::size_t chunk_length) const noexcept -> bool {
+		auto before = std::size_t{0};
+		if (representation == index_kind::bitmap) {
+			for (std::size_t w = 0; w < bits.size(); ++w) {
+				if (w % words_per_superblock == 0 and ranks[w / words_per_superblock] != before) {
+					return false;
+				}
+				before += popcount(bits[w]);
+			}
+			const auto last_word = (bits.size() - 1) * block_size;
+			if ((bits.back() & ~low_bits(chunk_length - last_word)) != 0 or ranks.back() != before) {
+				return false;
+			}
+		}
+		else if (representation == index_kind::offsets) {
+			for (std::size_t i = 0; i < starts.size(); ++i) {
+				if (starts[i] >= chunk_length or (i > 0 and starts[i] <= starts[i - 1])) {
+					return false;
+				}
+			}
+			before = starts.size();
+		}
+		else {
+			for (std::size_t i = 0; i < starts.size(); ++i) {
+				if (starts[i] > lasts[i] or lasts[i] >= chunk_length or (i > 0 and starts[i] <= lasts[i - 1])
+				    or ranks[i] != before)
+				{
+					return false;
+				}
+				before += std::size_t{lasts[i]} - starts[i] + 1;
+			}
+		}
+		return before == accepted;
+	}
+	auto acceptance_index::container::fill(chunk_words& out) const noexcept -> std::size_t {
+		if (representation == index_kind::bitmap) {
+			std::copy(bits.begin(), bits.end(), out.begin());
+			return word_count;
+		}
+		std::fill(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(word_count), std::uint64_t{0});
+		if (representation == index_kind::offsets) {
+			for (const auto offset : starts) {
+				out[offset / block_size] |= std::uint64_t{1} << (offset % block_size);
+			}
+			return word_count;
+		}
+		for (std::size_t w = 0; w < word_count; ++w) {
+			out[w] = word_at(w * block_size);
+		}
+		return word_count;
+	}
+
+	acceptance_index::acceptance_index(std::size_t length)
+	: storage()
+	, chunks()
+	, ready(0)
+	, accepted(0)
+	, raw_length(length)
+	, open()
+	, bits()
+	, bits_filled()
+	, bits_built(false) {
+		chunks.reserve(ceil_div(length, chunk_size));
+	}
+	acceptance_index::acceptance_index(std::vector<std::uint64_t> words, std::size_t length)
+	: acceptance_index(length) {
+		for (std::size_t w = 0; w < words.size(); w += words_per_chunk) {
+			append_chunk(std::span<const std::uint64_t>(words).subspan(w, std::min(words_per_chunk, words.size() - w)));
+		}
+	}
+	auto acceptance_index::append_chunk(std::span<const std::uint64_t> words) -> void {
+		chunks.emplace_back(words, accepted);
+		accepted += chunks.back().count();
+		ready.store(chunks.size(), std::memory_order_release);
+	}
+	// Classifies up to max_chunks more chunks of the buffer the index covers and reports whether
+	// the index is now complete. Only one thread may append at a time.
+	auto acceptance_index::append_chunks(const char* ptr, const filter& pred, std::size_t max_chunks) -> bool {
+		const auto scan = scanner(pred);
+		auto words = chunk_words();
+		for (; max_chunks > 0 and not complete(); --max_chunks) {
+			const auto chunk = chunks.size() * chunk_size;
+			const auto chunk_length = std::min(chunk_size, raw_length - chunk);
+			const auto word_count = ceil_div(chunk_length, block_size);
+			for (std::size_t w = 0; w < word_count; ++w) {
+				const auto offset = w * block_size;
+				words[w] = scan.mask(ptr + chunk + offset, std::min(block_size, chunk_length - offset));
+			}
+			append_chunk(std::span<const std::uint64_t>(words.data(), word_count));
+		}
+		return complete();
+	}
+	// Each new word is added to the open chunk with its popcount; a chunk is only packed when it
+	// fills.
+	auto acceptance_index::extend(const char* ptr, const filter& pred, std::size_t new_length) -> void {
+		const auto old_length = raw_length;
+		if (chunks.size() * chunk_size > old_length) {
+			unpack_last();
+		}
+		raw_length = new_length;
+		if (chunks.capacity() < ceil_div(new_length, chunk_size)) {
+			chunks.reserve(std::max(ceil_div(new_length, chunk_size), 2 * chunks.capacity()));
+		}
+		const auto scan = scanner(pred);
+		for (auto offset = old_length; offset < new_length;) {
+			const auto bit = offset % block_size;
+			const auto n = std::min(block_size - bit, new_length - offset);
+			const auto fresh = scan.mask(ptr + offset, n) << bit;
+			if (bit == 0) {
+				add_open_word(fresh);
+			}
+			else {
+				open.words.back() |= fresh;
+				open.count += popcount(fresh);
+			}
+			offset += n;
+			if (offset % chunk_size == 0) {
+				pack_open();
+			}
+		}
+		if (bits_built.load(std::memory_order_relaxed)) {
+			bits.resize(ceil_div(new_length, block_size));
+			for (auto w = old_length / block_size; w < bits.size(); ++w) {
+				bits[w] = word_at(w * block_size) & low_bits(new_length - w * block_size);
+			}
+		}
+	}
+	auto acceptance_index::finish() -> void {
+		if (not open.words.empty()) {
+			pack_open();
+		}
+	}
+	auto acceptance_index::add_open_word(std::uint64_t word) -> void {
+		if (open.words.size() % words_per_superblock == 0) {
+			open.ranks.push_back(static_cast<std::uint32_t>(open.count));
+		}
+		open.words.push_back(word);
+		open.count += popcount(word);
+	}
+	auto acceptance_index::pack_open() -> void {
+		append_chunk(open.words);
+		open.words.clear();
+		open.ranks.clear();
+		open.count = 0;
+	}
+	// Reopens a partial last chunk that finish() or append_chunks() packed.
+	auto acceptance_index::unpack_last() -> void {
+		auto words = chunk_words();
+		const auto n = chunks.back().fill(words);
+		accepted -= chunks.back().count();
+		chunks.pop_back();
+		ready.store(chunks.size(), std::memory_order_release);
+		for (std::size_t w = 0; w < n; ++w) {
+			add_open_word(words[w]);
+		}
+	}
+	// The buffer is classified one chunk at a time, so building never holds more than one chunk's
+	// uncompressed bitmap.
+	auto acceptance_index::build(const char* ptr, std::size_t length, const filter& pred)
+	    -> std::unique_ptr<const acceptance_index> {
+		auto index = std::make_unique<acceptance_index>(length);
+		index->append_chunks(ptr, pred, ceil_div(length, chunk_size));
+		return index;
+	}
+	// Each block is classified by every predicate while it is still in cache, so the buffer is
+	// read from memory once regardless of how many predicates there are.
+	auto acceptance_index::build_all(const char* ptr, std::size_t length, const std::vector<filter>& preds)
+	    -> std::vector<std::shared_ptr<const acceptance_index>> {
+		auto scanners = std::vector<scanner>{};
+		auto words = std::vector<chunk_words>(preds.size());
+		auto indexes = std::vector<std::shared_ptr<acceptance_index>>{};
+		scanners.reserve(preds.size());
+		indexes.reserve(preds.size());
+		for (const auto& pred : preds) {
+			scanners.emplace_back(pred);
+			indexes.push_back(std::make_shared<acceptance_index>(length));
+		}
+		for (std::size_t chunk = 0; chunk < length; chunk += chunk_size) {
+			const auto chunk_length = std::min(chunk_size, length - chunk);
+			const auto word_count = ceil_div(chunk_length, block_size);
+			for (std::size_t w = 0; w < word_count; ++w) {
+				const auto offset = w * block_size;
+				const auto n = std::min(block_size, chunk_length - offset);
+				for (std::size_t p = 0; p < scanners.size(); ++p) {
+					words[p][w] = scanners[p].mask(ptr + chunk + offset, n);
+				}
+			}
+			for (std::size_t p = 0; p < indexes.size(); ++p) {
+				indexes[p]->append_chunk(std::span<const std::uint64_t>(words[p].data(), word_count));
+			}
+		}
+		return {indexes.begin(), indexes.end()};
+	}
+	// Chunks where either side keeps its offsets are intersected by probing the other side for
+	// each offset; the rest are intersected word by word.
+	auto acceptance_index::intersect(const acceptance_index& lhs, const acceptance_index& rhs)
+	    -> std::shared_ptr<const acceptance_index> {
+		auto result = std::make_shared<acceptance_index>(lhs.length());
+		auto lhs_words = chunk_words();
+		auto rhs_words = chunk_words();
+		for (std::size_t c = 0; c < lhs.chunk_count(); ++c) {
+			const auto packed = c < lhs.chunks.size() and c < rhs.chunks.size();
+			if (packed
+			    and (lhs.chunks[c].kind() == index_kind::offsets or rhs.chunks[c].kind() == index_kind::offsets))
+			{
+				const auto& l = lhs.chunks[c];
+				const auto& r = rhs.chunks[c];
+				const auto& sparse = l.kind() == index_kind::offsets ? l : r;
+				const auto& other = l.kind() == index_kind::offsets ? r : l;
+				auto offsets = std::vector<std::uint16_t>{};
+				for (const auto offset : sparse.offsets()) {
+					if (other.contains(offset)) {
+						offsets.push_back(offset);
+					}
+				}
+				const auto word_count = ceil_div(std::min(chunk_size, lhs.length() - c * chunk_size), block_size);
+				result->chunks.emplace_back(std::move(offsets), word_count, result->accepted);
+				result->accepted += result->chunks.back().count();
+				result->ready.store(result->chunks.size(), std::memory_order_release);
+				continue;
+			}
+			const auto n = lhs.fill_chunk(c, lhs_words);
+			rhs.fill_chunk(c, rhs_words);
+			for (std::size_t w = 0; w < n; ++w) {
+				lhs_words[w] &= rhs_words[w];
+			}
+			result->append_chunk(std::span<const std::uint64_t>(lhs_words.data(), n));
+		}
+		return result;
+	}
+	auto acceptance_index::complete() const noexcept -> bool {
+		return ready.load(std::memory_order_acquire) * chunk_size >= raw_length or not open.words.empty();
+	}
+	// The open chunk only exists once extend() has returned, so it is always part of the prefix.
+	auto acceptance_index::prefix() const noexcept -> index_prefix {
+		const auto n = ready.load(std::memory_order_acquire);
+		if (not open.words.empty()) {
+			return index_prefix{raw_length, count_through(n) + open.count};
+		}
+		return index_prefix{std::min(n * chunk_size, raw_length), count_through(n)};
+	}
+	auto acceptance_index::count_through(std::size_t n) const noexcept -> std::size_t {
+		return n == 0 ? 0 : chunks[n - 1].rank_base() + chunks[n - 1].count();
+	}
+	auto acceptance_index::chunk_count() const noexcept -> std::size_t {
+		return chunks.size() + (open.words.empty() ? 0 : 1);
+	}
+	auto acceptance_index::fill_chunk(std::size_t c, chunk_words& out) const noexcept -> std::size_t {
+		if (c < chunks.size()) {
+			return chunks[c].fill(out);
+		}
+		std::copy(open.words.begin(), open.words.end(), out.begin());
+		return open.words.size();
+	}
+	// The word at offset in chunk c, where the open chunk follows the first ready_chunks chunks.
+	auto acceptance_index::chunk_word_at(std::size_t c, std::size_t ready_chunks, std::size_t offset) const noexcept
+	    -> std::uint64_t {
+		if (c < ready_chunks) {
+			return chunks[c].word_at(offset);
+		}
+		return c == ready_chunks ? bitmap_word_at(open.words, offset) : 0;
+	}
+	auto acceptance_index::kind() const noexcept -> index_kind {
+		const auto n = ready.load(std::memory_order_acquire);
+		if (n == 0) {
+			return index_kind::bitmap;
+		}
+		// The open chunk is a plain bitmap until it is packed.
+		const auto first = chunks.front().kind();
+		const auto same = std::all_of(chunks.begin(),
+		                              chunks.begin() + static_cast<std::ptrdiff_t>(n),
+		                              [first](const container& chunk) { return chunk.kind() == first; });
+		return same and (open.words.empty() or first == index_kind::bitmap) ? first : index_kind::mixed;
+	}
+	// The materialised bitmap is only counted once words() has published it.
+	auto acceptance_index::bytes() const noexcept -> std::size_t {
+		const auto n = ready.load(std::memory_order_acquire);
+		auto total = chunks.capacity() * sizeof(container) + open.words.capacity() * sizeof(std::uint64_t)
+		             + open.ranks.capacity() * sizeof(std::uint32_t);
+		if (bits_built.load(std::memory_order_acquire)) {
+			total += bits.capacity() * sizeof(std::uint64_t);
+		}
+		for (std::size_t c = 0; c < n; ++c) {
+			total += chunks[c].bytes();
+		}
+		return total;
+	}
+	auto acceptance_index::length() const noexcept -> std::size_t {
+		return raw_length;
+	}
+	auto acceptance_index::count() const noexcept -> std::size_t {
+		return accepted + open.count;
+	}
+	auto acceptance_index::rank(std::size_t raw_offset) const noexcept -> std::size_t {
+		const auto c = raw_offset / chunk_size;
+		if (const auto n = ready.load(std::memory_order_acquire); c >= n) {
+			const auto offset = raw_offset - n * chunk_size;
+			if (offset / block_size < open.words.size()) {
+				return count_through(n) + bitmap_rank(open.words, open.ranks, offset);
+			}
+			return count_through(n) + open.count;
+		}
+		return chunks[c].rank_base() + chunks[c].rank(raw_offset % chunk_size);
+	}
+	auto acceptance_index::select(std::size_t k) const noexcept -> std::size_t {
+		if (not open.words.empty() and k >= accepted) {
+			return chunks.size() * chunk_size + bitmap_select(open.words, open.ranks, k - accepted);
+		}
+		const auto ready_end = chunks.begin() + static_cast<std::ptrdiff_t>(ready.load(std::memory_order_acquire));
+		const auto next = std::upper_bound(chunks.begin(), ready_end, k, [](std::size_t value, const container& chunk) {
+			return value < chunk.rank_base();
+		});
+		const auto c = static_cast<std::size_t>(std::distance(chunks.begin(), next) - 1);
+		return c * chunk_size + chunks[c].select(k - chunks[c].rank_base());
+	}
+	auto acceptance_index::words() const -> std::span<const std::uint64_t> {
+		std::call_once(bits_filled, [this] {
+			auto filled = std::vector<std::uint64_t>(ceil_div(raw_length, block_size));
+			auto chunk = chunk_words();
+			for (std::size_t c = 0; c < chunks.size(); ++c) {
+				const auto n = chunks[c].fill(chunk);
+				std::copy(chunk.begin(),
+				          chunk.begin() + static_cast<std::ptrdiff_t>(n),
+				          filled.begin() + static_cast<std::ptrdiff_t>(c * words_per_chunk));
+			}
+			std::copy(open.words.begin(),
+			          open.words.end(),
+			          filled.begin() + static_cast<std::ptrdiff_t>(chunks.size() * words_per_chunk));
+			bits = std::move(filled);
+			bits_built.store(true, std::memory_order_release);
+		});
+		return bits;
+	}
+	auto acceptance_index::word_at(std::size_t raw_offset) const noexcept -> std::uint64_t {
+		const auto c = raw_offset / chunk_size;
+		const auto n = ready.load(std::memory_order_acquire);
+		const auto offset = raw_offset % chunk_size;
+		auto result = chunk_word_at(c, n, offset);
+		if (offset + block_size > chunk_size) {
+			result |= chunk_word_at(c + 1, n, 0) << (chunk_size - offset);
+		}
+		return result;
+	}
+	auto acceptance_index::slice(std::size_t raw_offset, std::size_t length) const
+	    -> std::unique_ptr<const acceptance_index> {
+		auto index = std::make_unique<acceptance_index>(length);
+		auto words = chunk_words();
+		for (std::size_t chunk = 0; chunk < length; chunk += chunk_size) {
+			const auto chunk_length = std::min(chunk_size, length - chunk);
+			const auto word_count = ceil_div(chunk_length, block_size);
+			for (std::size_t w = 0; w < word_count; ++w) {
+				const auto offset = w * block_size;
+				words[w] = word_at(raw_offset + chunk + offset) & low_bits(chunk_length - offset);
+			}
+			index->append_chunk(std::span<const std::uint64_t>(words.data(), word_count));
+		}
+		return index;
+	}
+	auto acceptance_index::save(std::ostream& out) const -> void {
+		const auto header = image_header{raw_length, count(), chunk_count()};
+		write_bytes(out, &header, sizeof(header));
+		for (const auto& chunk : chunks) {
+			chunk.save(out);
+		}
+		if (not open.words.empty()) {
+			container(open.words, accepted).save(out);
+		}
+	}
+	// The containers point straight into the image once their contents have been checked.
+	auto acceptance_index::load(std::span<const std::byte> image, std::shared_ptr<const void> storage)
+	    -> std::unique_ptr<const acceptance_index> {
+		auto position = std::size_t{0};
+		const auto header = read_struct<image_header>(image, position);
+		if (reinterpret_cast<std::uintptr_t>(image.data()) % alignof(std::uint64_t) != 0 or not header
+		    or header->chunk_count != ceil_div(header->raw_length, chunk_size))
+		{
+			return nullptr;
+		}
+		auto index = std::make_unique<acceptance_index>(header->raw_length);
+		index->storage = std::move(storage);
+		for (std::size_t c = 0; c < header->chunk_count; ++c) {
+			const auto chunk_length = std::min(chunk_size, index->raw_length - c * chunk_size);
+			auto chunk = container::load(image, position, index->accepted, chunk_length);
+			if (not chunk) {
+				return nullptr;
+			}
+			index->chunks.push_back(std::move(*chunk));
+			index->accepted += index->chunks.back().count();
+		}
+		if (index->accepted != header->accepted) {
+			return nullptr;
+		}
+		index->ready.store(index->chunks.size(), std::memory_order_release);
+		return index;
+	}
+
+	index_window::index_window() noexcept
+	: idx(nullptr)
+	, base_offset(0)
+	, window_length(0)
+	, rank_base(0) {}
+	index_window::index_window(const acceptance_index* index, std::size_t base, std::size_t length) noexcept
+	: idx(index)
+	, base_offset(base)
+	, window_length(length)
+	, rank_base(index->rank(base)) {}
+	index_window::operator bool() const noexcept {
+		return idx != nullptr;
+	}
+	auto index_window::count() const noexcept -> std::size_t {
+		return rank(window_length);
+	}
+	auto index_window::rank(std::size_t raw_offset) const noexcept -> std::size_t {
+		return idx != nullptr ? idx->rank(base_offset + raw_offset) - rank_base : 0;
+	}
+	auto index_window::select(std::size_t k) const noexcept -> std::size_t {
+		return idx->select(rank_base + k) - base_offset;
+	}
+	// The raw offset just past the k-th accepted character: the boundary between filtered
+	// positions k - 1 and k, not counting any rejected characters that follow.
+	auto index_window::boundary(std::size_t k) const noexcept -> std::size_t {
+		return k == 0 ? 0 : select(k - 1) + 1;
+	}
+	auto index_window::word_at(std::size_t raw_offset) const noexcept -> std::uint64_t {
+		if (idx == nullptr or raw_offset >= window_length) {
+			return 0;
+		}
+		return idx->word_at(base_offset + raw_offset) & low_bits(window_length - raw_offset);
+	}
+	auto index_window::base() const noexcept -> std::size_t {
+		return base_offset;
+	}
+
+	namespace {
+		constexpr auto unknown_size = static_cast<std::size_t>(-1);
+	} // namespace
+	view_state::view_state(filter pred) noexcept
+	: pred(std::move(pred))
+	, owner()
+	, borrowed()
+	, borrowed_base(0)
+	, own(nullptr)
+	, size(unknown_size)
+	, growing_lock()
+	, partial()
+	, growing(nullptr)
+	, background() {}
+	view_state::view_state(filter pred, std::shared_ptr<const acceptance_index> index) noexcept
+	: pred(std::move(pred))
+	, owner()
+	, borrowed(std::move(index))
+	, borrowed_base(0)
+	, own(nullptr)
+	, size(unknown_size)
+	, growing_lock()
+	, partial()
+	, growing(nullptr)
+	, background() {}
+	view_state::view_state(std::shared_ptr<const view_state> owner,
+	                       std::shared_ptr<const acceptance_index> index,
+	                       std::size_t base) noexcept
+	: pred()
+	, owner(std::move(owner))
+	, borrowed(std::move(index))
+	, borrowed_base(base)
+	, own(nullptr)
+	, size(unknown_size)
+	, growing_lock()
+	, partial()
+	, growing(nullptr)
+	, background() {}
+	view_state::~view_state() {
+		if (background.joinable()) {
+			background.request_stop();
+			background.join();
+		}
+		delete own.load(std::memory_order_acquire);
+	}
+	// A child view keeps a reference to the parent's predicate and, when the parent has been
+	// indexed, to the parent's index at the child's offset, so it never has to rescan. An index the
+	// parent built itself is shared by keeping the parent's control block alive.
+	auto view_state::child(const std::shared_ptr<const view_state>& parent, std::size_t offset)
+	    -> std::shared_ptr<const view_state> {
+		auto owner = parent->owner ? parent->owner : parent;
+		if (const auto* parent_own = parent->own.load(std::memory_order_acquire)) {
+			return std::make_shared<const view_state>(std::move(owner),
+			                                          std::shared_ptr<const acceptance_index>(parent, parent_own),
+			                                          offset);
+		}
+		if (parent->borrowed) {
+			return std::make_shared<const view_state>(std::move(owner),
+			                                          parent->borrowed,
+			                                          parent->borrowed_base + offset);
+		}
+		return std::make_shared<const view_state>(std::move(owner), nullptr, 0);
+	}
+	auto view_state::predicate() const noexcept -> const filter& {
+		return owner ? owner->pred : pred;
+	}
+	auto view_state::window(std::size_t length) const noexcept -> index_window {
+		if (const auto* index = own.load(std::memory_order_acquire)) {
+			return index_window(index, 0, length);
+		}
+		if (borrowed) {
+			return index_window(borrowed.get(), borrowed_base, length);
+		}
+		return index_window();
+	}
+	auto view_state::ensure_window(const char* ptr, std::size_t length) const -> index_window {
+		if (const auto existing = window(length)) {
+			return existing;
+		}
+		return index_window(&finish(ptr, length), 0, length);
+	}
+	// Grows the index by at most chunks_per_step chunks, unless another thread is already growing
+	// it, and returns whatever index is available: complete, partial or none.
+	auto view_state::advance(const char* ptr, std::size_t length) const -> const acceptance_index* {
+		if (const auto* index = own.load(std::memory_order_acquire)) {
+			return index;
+		}
+		if (auto lock = std::unique_lock(growing_lock, std::try_to_lock); lock.owns_lock()) {
+			step(ptr, length, chunks_per_step);
+		}
+		if (const auto* index = own.load(std::memory_order_acquire)) {
+			return index;
+		}
+		return growing.load(std::memory_order_acquire);
+	}
+	// The thread is joined when the last view sharing this state is destroyed, so the buffer must
+	// outlive the views as it always has to.
+	auto view_state::build_in_background(const char* ptr, std::size_t length) const -> void {
+		auto lock = std::lock_guard(growing_lock);
+		if (own.load(std::memory_order_acquire) != nullptr or background.joinable()) {
+			return;
+		}
+		background = std::jthread([this, ptr, length](std::stop_token stop) {
+			while (not stop.stop_requested()) {
+				auto step_lock = std::lock_guard(growing_lock);
+				if (step(ptr, length, chunks_per_step)) {
+					return;
+				}
+			}
+		});
+	}
+	auto view_state::aligned_index(const char* ptr, std::size_t length) const -> const acceptance_index& {
+		if (const auto* index = own.load(std::memory_order_acquire)) {
+			return *index;
+		}
+		if (borrowed and borrowed_base == 0 and borrowed->length() == length) {
+			return *borrowed;
+		}
+		if (borrowed) {
+			return publish(borrowed->slice(borrowed_base, length));
+		}
+		return finish(ptr, length);
+	}
+	auto view_state::stats() const noexcept -> index_info {
+		if (const auto* index = own.load(std::memory_order_acquire)) {
+			return index_info{index->kind(), index->bytes()};
+		}
+		if (const auto* index = growing.load(std::memory_order_acquire)) {
+			return index_info{index->kind(), index->bytes()};
+		}
+		if (borrowed) {
+			return index_info{borrowed->kind(), borrowed->bytes()};
+		}
+		return index_info{index_kind::none, 0};
+	}
+	// The size is a single word that nothing else depends on, so relaxed ordering is enough; two
+	// threads that both count store the same value.
+	auto view_state::cached_size() const noexcept -> std::optional<std::size_t> {
+		if (const auto cached = size.load(std::memory_order_relaxed); cached != unknown_size) {
+			return cached;
+		}
+		return std::nullopt;
+	}
+	auto view_state::publish_size(std::size_t accepted) const noexcept -> void {
+		size.store(accepted, std::memory_order_relaxed);
+	}
+	auto view_state::publish(std::unique_ptr<const acceptance_index> index) const -> const acceptance_index& {
+		const acceptance_index* expected = nullptr;
+		if (own.compare_exchange_strong(expected, index.get(), std::memory_order_acq_rel, std::memory_order_acquire)) {
+			return *index.release();
+		}
+		return *expected;
+	}
+	auto view_state::adopt(std::unique_ptr<const acceptance_index> index) const -> void {
+		static_cast<void>(publish(std::move(index)));
+	}
+	// A build that is already under way is finished rather than started again.
+	auto view_state::finish(const char* ptr, std::size_t length) const -> const acceptance_index& {
+		if (growing.load(std::memory_order_acquire) != nullptr) {
+			auto lock = std::lock_guard(growing_lock);
+			step(ptr, length, std::numeric_limits<std::size_t>::max());
+			return *own.load(std::memory_order_acquire);
+		}
+		return publish(acceptance_index::build(ptr, length, predicate()));
+	}
+	// Requires growing_lock. Returns true once the view has a complete index. A partial index that
+	// loses the race to publish is kept until the state is destroyed, since readers may hold it.
+	auto view_state::step(const char* ptr, std::size_t length, std::size_t max_chunks) const -> bool {
+		if (own.load(std::memory_order_acquire) != nullptr) {
+			return true;
+		}
+		if (not partial) {
+			partial = std::make_unique<acceptance_index>(length);
+			growing.store(partial.get(), std::memory_order_release);
+		}
+		if (not partial->append_chunks(ptr, predicate(), max_chunks)) {
+			return false;
+		}
+		const acceptance_index* expected = nullptr;
+		const auto* complete = partial.get();
+		if (own.compare_exchange_strong(expected, complete, std::memory_order_acq_rel, std::memory_order_acquire)) {
+			static_cast<void>(partial.release());
+		}
+		return true;
+	}
+} // namespace fsv::detail
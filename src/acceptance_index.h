@@ -0,0 +1,341 @@
+#ifndef COMP6771_ASS2_ACCEPTANCE_INDEX_H
+#define COMP6771_ASS2_ACCEPTANCE_INDEX_H
+
+#include "./filtered_string_view.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace fsv::detail {
+	constexpr auto block_size = std::size_t{64};
+	// Views at least this long build their index rather than scan when asked for a position.
+	constexpr auto index_threshold = std::size_t{4096};
+	// How many chunks of an index a single at() may build, bounding the latency of that call.
+	constexpr auto chunks_per_step = std::size_t{16};
+
+	inline auto low_bits(std::size_t n) noexcept -> std::uint64_t {
+		return n >= block_size ? ~std::uint64_t{0} : (std::uint64_t{1} << n) - 1;
+	}
+	inline auto popcount(std::uint64_t word) noexcept -> std::size_t {
+		return static_cast<std::size_t>(std::popcount(word));
+	}
+	inline auto select_bit(std::uint64_t word, std::size_t k) noexcept -> std::size_t {
+		for (; k > 0; --k) {
+			word &= word - 1;
+		}
+		return static_cast<std::size_t>(std::countr_zero(word));
+	}
+
+	// The predicate compose() builds: a flat list of leaves, with every char_class folded into one
+	// table kept first. mask() evaluates the leaves a block at a time, each one only on the bytes
+	// the leaves before it accepted, as calling them byte by byte would.
+	class conjunction {
+	 public:
+		explicit conjunction(std::vector<filter> leaves) noexcept;
+		auto operator()(const char& c) const -> bool;
+		[[nodiscard]] auto mask(const char* block, std::size_t n) const -> std::uint64_t;
+		[[nodiscard]] auto leaves() const noexcept -> const std::vector<filter>&;
+
+	 private:
+		std::vector<filter> leaf_filters;
+	};
+	// The bits of candidates whose bytes in block pred accepts. Byte tables, block_filters and
+	// conjunctions classify the whole block at once; other predicates are called on the candidate
+	// bytes only.
+	[[nodiscard]] auto mask_of(const filter& pred, const char* block, std::size_t n, std::uint64_t candidates)
+	    -> std::uint64_t;
+
+	// Evaluates a predicate over up to 64 bytes at a time, setting bit i of the result when
+	// block[i] is accepted. Byte tables from char_class are looked up without branching, and
+	// block_filters and conjunctions are called once per block.
+	class scanner {
+	 public:
+		explicit scanner(const filter& pred) noexcept;
+		[[nodiscard]] auto mask(const char* block, std::size_t n) const -> std::uint64_t;
+
+	 private:
+		const filter* pred;
+		const char_class* table;
+		const block_filter* blocks;
+		const conjunction* conjoined;
+	};
+
+	// Calls visit(offset, mask) for each block of the buffer until it returns false.
+	template<typename Visitor>
+	auto for_each_block(const char* ptr, std::size_t length, const filter& pred, Visitor visit) -> void {
+		const auto scan = scanner(pred);
+		for (std::size_t offset = 0; offset < length; offset += block_size) {
+			const auto n = std::min(block_size, length - offset);
+			if (not visit(offset, scan.mask(ptr + offset, n))) {
+				return;
+			}
+		}
+	}
+
+	// The leading part of a buffer that an index under construction covers so far, and how many
+	// bytes of it are accepted.
+	struct index_prefix {
+		std::size_t length;
+		std::size_t count;
+	};
+
+	// The accepted positions of a raw buffer, answering rank and select. The buffer is split into
+	// 64 KiB chunks and each chunk keeps whichever container is smallest for it: a bitmap (bit i of
+	// word w is byte 64 * w + i) with a cumulative count per 512-bit superblock, so that rank and
+	// select never touch more than eight words; the sorted accepted offsets, for sparse chunks; or
+	// the accepted intervals, for chunks accepted in long runs. Memory therefore follows how
+	// compressible the acceptance pattern is rather than the length of the buffer.
+	class acceptance_index {
+	 public:
+		static constexpr auto chunk_size = std::size_t{1} << 16U;
+		static constexpr auto words_per_chunk = chunk_size / block_size;
+		static constexpr auto words_per_superblock = std::size_t{8};
+		using chunk_words = std::array<std::uint64_t, words_per_chunk>;
+
+		// An empty index over length bytes, filled one chunk at a time by append_chunk(). While it is
+		// being filled, other threads may query the chunks already appended: rank up to
+		// prefix().length, select below prefix().count, and word_at.
+		explicit acceptance_index(std::size_t length);
+		acceptance_index(std::vector<std::uint64_t> words, std::size_t length);
+		[[nodiscard]] static auto build(const char* ptr, std::size_t length, const filter& pred)
+		    -> std::unique_ptr<const acceptance_index>;
+		[[nodiscard]] static auto build_all(const char* ptr, std::size_t length, const std::vector<filter>& preds)
+		    -> std::vector<std::shared_ptr<const acceptance_index>>;
+		[[nodiscard]] static auto intersect(const acceptance_index& lhs, const acceptance_index& rhs)
+		    -> std::shared_ptr<const acceptance_index>;
+		// Combines two indexes over the same buffer chunk by chunk, word by word.
+		template<typename WordOp>
+		[[nodiscard]] static auto combine(const acceptance_index& lhs, const acceptance_index& rhs, WordOp op)
+		    -> std::shared_ptr<const acceptance_index> {
+			auto result = std::make_shared<acceptance_index>(lhs.length());
+			auto lhs_words = chunk_words();
+			auto rhs_words = chunk_words();
+			for (std::size_t c = 0; c < lhs.chunk_count(); ++c) {
+				const auto n = lhs.fill_chunk(c, lhs_words);
+				rhs.fill_chunk(c, rhs_words);
+				std::transform(lhs_words.begin(),
+				               lhs_words.begin() + static_cast<std::ptrdiff_t>(n),
+				               rhs_words.begin(),
+				               lhs_words.begin(),
+				               op);
+				result->append_chunk(std::span<const std::uint64_t>(lhs_words.data(), n));
+			}
+			return result;
+		}
+
+		auto append_chunk(std::span<const std::uint64_t> words) -> void;
+		auto append_chunks(const char* ptr, const filter& pred, std::size_t max_chunks) -> bool;
+		// Grows an index that no other thread is reading to cover new_length bytes of the buffer at
+		// ptr, whose first length() bytes must be unchanged. Only the new bytes are classified, and a
+		// partial last chunk is kept as raw words until it fills, so an append costs time in
+		// proportion to the bytes appended.
+		auto extend(const char* ptr, const filter& pred, std::size_t new_length) -> void;
+		// Packs a partial last chunk left by extend() into its smallest container. The next extend()
+		// unpacks it again.
+		auto finish() -> void;
+		[[nodiscard]] auto complete() const noexcept -> bool;
+		[[nodiscard]] auto prefix() const noexcept -> index_prefix;
+		[[nodiscard]] auto kind() const noexcept -> index_kind;
+		[[nodiscard]] auto bytes() const noexcept -> std::size_t;
+		[[nodiscard]] auto length() const noexcept -> std::size_t;
+		[[nodiscard]] auto count() const noexcept -> std::size_t;
+		[[nodiscard]] auto rank(std::size_t raw_offset) const noexcept -> std::size_t;
+		[[nodiscard]] auto select(std::size_t k) const noexcept -> std::size_t;
+		[[nodiscard]] auto words() const -> std::span<const std::uint64_t>;
+		[[nodiscard]] auto word_at(std::size_t raw_offset) const noexcept -> std::uint64_t;
+		[[nodiscard]] auto slice(std::size_t raw_offset, std::size_t length) const
+		    -> std::unique_ptr<const acceptance_index>;
+		// Writes the index in a form that load() can use in place once the bytes are mapped back in.
+		auto save(std::ostream& out) const -> void;
+		// Returns nothing if image is not a well-formed index; storage keeps image alive.
+		[[nodiscard]] static auto load(std::span<const std::byte> image, std::shared_ptr<const void> storage)
+		    -> std::unique_ptr<const acceptance_index>;
+
+	 private:
+		[[nodiscard]] auto count_through(std::size_t n) const noexcept -> std::size_t;
+		[[nodiscard]] auto chunk_count() const noexcept -> std::size_t;
+		auto fill_chunk(std::size_t c, chunk_words& out) const noexcept -> std::size_t;
+		[[nodiscard]] auto chunk_word_at(std::size_t c, std::size_t ready_chunks, std::size_t offset) const noexcept
+		    -> std::uint64_t;
+		auto add_open_word(std::uint64_t word) -> void;
+		auto pack_open() -> void;
+		auto unpack_last() -> void;
+
+		// One chunk's accepted offsets, all relative to the start of the chunk. Its arrays are either
+		// its own or views into a mapped index file.
+		class container {
+		 public:
+			container(std::span<const std::uint64_t> words, std::size_t rank_base);
+			container(std::vector<std::uint16_t> offsets, std::size_t word_count, std::size_t rank_base);
+			container(index_kind kind,
+			          std::size_t word_count,
+			          std::size_t rank_base,
+			          std::size_t count,
+			          std::span<const std::uint64_t> bits,
+			          std::span<const std::uint32_t> ranks,
+			          std::span<const std::uint16_t> starts,
+			          std::span<const std::uint16_t> lasts) noexcept;
+			container(const container&) = delete;
+			container(container&&) noexcept = default;
+			auto operator=(const container&) -> container& = delete;
+			auto operator=(container&&) noexcept -> container& = default;
+			[[nodiscard]] auto kind() const noexcept -> index_kind;
+			[[nodiscard]] auto bytes() const noexcept -> std::size_t;
+			[[nodiscard]] auto count() const noexcept -> std::size_t;
+			[[nodiscard]] auto rank_base() const noexcept -> std::size_t;
+			[[nodiscard]] auto rank(std::size_t offset) const noexcept -> std::size_t;
+			[[nodiscard]] auto select(std::size_t k) const noexcept -> std::size_t;
+			[[nodiscard]] auto contains(std::size_t offset) const noexcept -> bool;
+			[[nodiscard]] auto word_at(std::size_t offset) const noexcept -> std::uint64_t;
+			[[nodiscard]] auto offsets() const noexcept -> std::span<const std::uint16_t>;
+			auto fill(chunk_words& out) const noexcept -> std::size_t;
+			auto save(std::ostream& out) const -> void;
+			[[nodiscard]] static auto load(std::span<const std::byte> image,
+			                               std::size_t& position,
+			                               std::size_t rank_base,
+			                               std::size_t chunk_length) -> std::optional<container>;
+
+		 private:
+			auto use_owned() noexcept -> void;
+			[[nodiscard]] auto consistent(std::size_t chunk_length) const noexcept -> bool;
+
+			index_kind representation;
+			std::size_t base;
+			std::size_t accepted;
+			std::size_t word_count;
+			std::span<const std::uint64_t> bits;
+			// Bitmaps: accepted bytes before each superblock. Runs: accepted bytes before each run.
+			std::span<const std::uint32_t> ranks;
+			// Offsets: every accepted offset. Runs: the first and last offset of each run.
+			std::span<const std::uint16_t> starts;
+			std::span<const std::uint16_t> lasts;
+			std::vector<std::uint64_t> owned_bits;
+			std::vector<std::uint32_t> owned_ranks;
+			std::vector<std::uint16_t> owned_starts;
+			std::vector<std::uint16_t> owned_lasts;
+		};
+
+		// Keeps a mapped index file alive while containers point into it.
+		std::shared_ptr<const void> storage;
+		// Reserved up front, so appending never moves the chunks other threads are reading.
+		std::vector<container> chunks;
+		std::atomic<std::size_t> ready;
+		std::size_t accepted;
+		std::size_t raw_length;
+		// The last chunk while extend() is filling it: its raw words, how many bytes they accept and
+		// how many are accepted before each superblock. It follows the chunks and is not counted in
+		// accepted; it is empty whenever every chunk is packed.
+		struct open_chunk {
+			std::vector<std::uint64_t> words;
+			std::vector<std::uint32_t> ranks;
+			std::size_t count;
+		};
+		open_chunk open;
+		// The whole bitmap, only filled in if words() is called.
+		mutable std::vector<std::uint64_t> bits;
+		mutable std::once_flag bits_filled;
+		// Set with release ordering once bits is filled in, so that bytes() may read it from any
+		// thread and extend() keeps it up to date.
+		mutable std::atomic<bool> bits_built;
+	};
+
+	// The part of an acceptance index that a view covers: the view starts base bytes into the
+	// indexed buffer and spans length bytes. An empty window has no index and counts nothing.
+	class index_window {
+	 public:
+		index_window() noexcept;
+		index_window(const acceptance_index* index, std::size_t base, std::size_t length) noexcept;
+		explicit operator bool() const noexcept;
+		[[nodiscard]] auto count() const noexcept -> std::size_t;
+		[[nodiscard]] auto rank(std::size_t raw_offset) const noexcept -> std::size_t;
+		[[nodiscard]] auto select(std::size_t k) const noexcept -> std::size_t;
+		[[nodiscard]] auto boundary(std::size_t k) const noexcept -> std::size_t;
+		[[nodiscard]] auto word_at(std::size_t raw_offset) const noexcept -> std::uint64_t;
+		[[nodiscard]] auto base() const noexcept -> std::size_t;
+
+	 private:
+		const acceptance_index* idx;
+		std::size_t base_offset;
+		std::size_t window_length;
+		std::size_t rank_base;
+	};
+
+	// As above, but reads the masks from an index window instead of calling the predicate.
+	template<typename Visitor>
+	auto for_each_block(const char* ptr, std::size_t length, const filter& pred, index_window window, Visitor visit)
+	    -> void {
+		if (not window) {
+			for_each_block(ptr, length, pred, visit);
+			return;
+		}
+		for (std::size_t offset = 0; offset < length; offset += block_size) {
+			if (not visit(offset, window.word_at(offset))) {
+				return;
+			}
+		}
+	}
+
+	// Control block shared by every copy of a view, which may be read from several threads at once.
+	// The predicate and any borrowed index are fixed at construction. The view's own index is built
+	// lazily and published with a single compare-exchange on a plain pointer: every thread that
+	// finds no index builds one, the first to publish wins, and the others free theirs and use the
+	// winner's. Readers load the pointer with acquire ordering, so they see a fully built index.
+	//
+	// The index can also be grown a few chunks at a time, by advance() or by a background thread,
+	// so that no single query pays for indexing the whole buffer. Only one thread grows it at once;
+	// readers use the part built so far without taking the lock.
+	class view_state {
+	 public:
+		view_state(const view_state&) = delete;
+		auto operator=(const view_state&) -> view_state& = delete;
+		~view_state();
+		explicit view_state(filter pred) noexcept;
+		view_state(filter pred, std::shared_ptr<const acceptance_index> index) noexcept;
+		view_state(std::shared_ptr<const view_state> owner,
+		           std::shared_ptr<const acceptance_index> index,
+		           std::size_t base) noexcept;
+		[[nodiscard]] static auto child(const std::shared_ptr<const view_state>& parent, std::size_t offset)
+		    -> std::shared_ptr<const view_state>;
+
+		[[nodiscard]] auto predicate() const noexcept -> const filter&;
+		[[nodiscard]] auto window(std::size_t length) const noexcept -> index_window;
+		[[nodiscard]] auto ensure_window(const char* ptr, std::size_t length) const -> index_window;
+		[[nodiscard]] auto advance(const char* ptr, std::size_t length) const -> const acceptance_index*;
+		auto build_in_background(const char* ptr, std::size_t length) const -> void;
+		auto adopt(std::unique_ptr<const acceptance_index> index) const -> void;
+		[[nodiscard]] auto aligned_index(const char* ptr, std::size_t length) const -> const acceptance_index&;
+		[[nodiscard]] auto cached_size() const noexcept -> std::optional<std::size_t>;
+		[[nodiscard]] auto stats() const noexcept -> index_info;
+		auto publish_size(std::size_t size) const noexcept -> void;
+
+	 private:
+		auto publish(std::unique_ptr<const acceptance_index> index) const -> const acceptance_index&;
+		auto finish(const char* ptr, std::size_t length) const -> const acceptance_index&;
+		auto step(const char* ptr, std::size_t length, std::size_t max_chunks) const -> bool;
+
+		filter pred;
+		std::shared_ptr<const view_state> owner;
+		std::shared_ptr<const acceptance_index> borrowed;
+		std::size_t borrowed_base;
+		mutable std::atomic<const acceptance_index*> own;
+		mutable std::atomic<std::size_t> size;
+		mutable std::mutex growing_lock;
+		// Guarded by growing_lock; readers go through growing instead.
+		mutable std::unique_ptr<acceptance_index> partial;
+		mutable std::atomic<const acceptance_index*> growing;
+		mutable std::jthread background;
+	};
+} // namespace fsv::detail
+
+#endif // COMP6771_ASS2_ACCEPTANCE_INDEX_H
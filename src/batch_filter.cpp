@@ -0,0 +1,64 @@
+#include "./batch_filter.h"
+#include "./acceptance_index.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+namespace fsv {
+	filtered_batch::filtered_batch(std::string arena, std::vector<std::size_t> offsets) noexcept
+	: bytes(std::move(arena))
+	, bounds(std::move(offsets)) {}
+	auto filtered_batch::size() const noexcept -> std::size_t {
+		return bounds.size() - 1;
+	}
+	auto filtered_batch::empty() const noexcept -> bool {
+		return size() == 0;
+	}
+	auto filtered_batch::at(std::size_t n) const -> std::string_view {
+		if (n >= size()) {
+			throw std::domain_error("filtered_batch::at(" + std::to_string(n) + "): invalid index");
+		}
+		return (*this)[n];
+	}
+	auto filtered_batch::operator[](std::size_t n) const noexcept -> std::string_view {
+		return std::string_view(bytes).substr(bounds[n], bounds[n + 1] - bounds[n]);
+	}
+	auto filtered_batch::arena() const noexcept -> std::string_view {
+		return bytes;
+	}
+	auto filtered_batch::offsets() const noexcept -> std::span<const std::size_t> {
+		return bounds;
+	}
+
+	// The arena is sized for every byte to be accepted and trimmed at the end, so it is allocated once.
+	auto batch_filter(std::span<const std::string_view> inputs, const filter& predicate) -> filtered_batch {
+		auto total = std::size_t{0};
+		for (const auto input : inputs) {
+			total += input.size();
+		}
+		auto arena = std::string(total, '\0');
+		auto offsets = std::vector<std::size_t>();
+		offsets.reserve(inputs.size() + 1);
+		offsets.push_back(0);
+		const auto keep_all = predicate.target<detail::always_true>() != nullptr;
+		const auto scan = detail::scanner(predicate);
+		auto* out = arena.data();
+		for (const auto input : inputs) {
+			for (std::size_t offset = 0; offset < input.size(); offset += detail::block_size) {
+				const auto n = std::min(detail::block_size, input.size() - offset);
+				auto bits = keep_all ? detail::low_bits(n) : scan.mask(input.data() + offset, n);
+				if (bits == detail::low_bits(n)) {
+					out = std::copy_n(input.data() + offset, n, out);
+					continue;
+				}
+				for (; bits != 0; bits &= bits - 1) {
+					*out++ = input[offset + static_cast<std::size_t>(std::countr_zero(bits))];
+				}
+			}
+			offsets.push_back(static_cast<std::size_t>(out - arena.data()));
+		}
+		arena.resize(offsets.back());
+		return filtered_batch(std::move(arena), std::move(offsets));
+	}
+} // namespace fsv
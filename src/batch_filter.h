@@ -0,0 +1,38 @@
+#ifndef COMP6771_ASS2_BATCH_FILTER_H
+#define COMP6771_ASS2_BATCH_FILTER_H
+
+#include "./filtered_string_view.h"
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fsv {
+	// The filtered inputs of batch_filter(), back to back in one arena: input i is the bytes of
+	// arena() from offsets()[i] up to offsets()[i + 1].
+	class filtered_batch {
+	 public:
+		[[nodiscard]] auto size() const noexcept -> std::size_t;
+		[[nodiscard]] auto empty() const noexcept -> bool;
+		[[nodiscard]] auto at(std::size_t n) const -> std::string_view;
+		[[nodiscard]] auto operator[](std::size_t n) const noexcept -> std::string_view;
+		[[nodiscard]] auto arena() const noexcept -> std::string_view;
+		[[nodiscard]] auto offsets() const noexcept -> std::span<const std::size_t>;
+
+	 private:
+		friend auto batch_filter(std::span<const std::string_view> inputs, const filter& predicate) -> filtered_batch;
+		filtered_batch(std::string arena, std::vector<std::size_t> offsets) noexcept;
+		std::string bytes;
+		std::vector<std::size_t> bounds;
+	};
+
+	// Filters many short strings with one predicate. The predicate is inspected once for the whole
+	// batch, instead of being copied into a view per string, and every input is compacted 64 bytes
+	// at a time into a single allocation.
+	[[nodiscard]] auto batch_filter(std::span<const std::string_view> inputs,
+	                                const filter& predicate = default_predicate) -> filtered_batch;
+} // namespace fsv
+
+#endif // COMP6771_ASS2_BATCH_FILTER_H
@@ -0,0 +1,192 @@
+#ifndef COMP6771_ASS2_CHAR_CLASS_H
+#define COMP6771_ASS2_CHAR_CLASS_H
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace fsv {
+	// A set of bytes compiled from a bracket expression such as "[A-Za-z0-9_]" or "[^[:space:]]".
+	// Supports ranges, negation, backslash escapes (\n, \t, \xHH, ...) and the POSIX classes
+	// [:alpha:], [:digit:], [:alnum:], [:upper:], [:lower:], [:space:], [:blank:], [:punct:],
+	// [:xdigit:], [:cntrl:], [:print:] and [:graph:] in the "C" locale.
+	class char_class {
+	 public:
+		using table_type = std::array<std::uint64_t, 4>;
+
+		constexpr char_class() noexcept
+		: bits{} {}
+		constexpr explicit char_class(const char* spec)
+		: bits{} {
+			parse(spec);
+		}
+		explicit char_class(const std::string& spec)
+		: char_class(spec.c_str()) {}
+
+		[[nodiscard]] constexpr auto contains(char c) const noexcept -> bool {
+			const auto byte = static_cast<unsigned char>(c);
+			return ((bits[byte >> 6U] >> (byte & 63U)) & 1U) != 0;
+		}
+		constexpr auto operator()(const char& c) const noexcept -> bool {
+			return contains(c);
+		}
+		[[nodiscard]] constexpr auto table() const noexcept -> const table_type& {
+			return bits;
+		}
+		[[nodiscard]] constexpr auto count() const noexcept -> std::size_t {
+			auto total = std::size_t{0};
+			for (const auto word : bits) {
+				total += static_cast<std::size_t>(std::popcount(word));
+			}
+			return total;
+		}
+
+		friend constexpr auto operator&(const char_class& lhs, const char_class& rhs) noexcept -> char_class {
+			auto result = char_class{};
+			for (std::size_t i = 0; i < result.bits.size(); ++i) {
+				result.bits[i] = lhs.bits[i] & rhs.bits[i];
+			}
+			return result;
+		}
+		friend constexpr auto operator|(const char_class& lhs, const char_class& rhs) noexcept -> char_class {
+			auto result = char_class{};
+			for (std::size_t i = 0; i < result.bits.size(); ++i) {
+				result.bits[i] = lhs.bits[i] | rhs.bits[i];
+			}
+			return result;
+		}
+		friend constexpr auto operator~(const char_class& cls) noexcept -> char_class {
+			auto result = char_class{};
+			for (std::size_t i = 0; i < result.bits.size(); ++i) {
+				result.bits[i] = ~cls.bits[i];
+			}
+			return result;
+		}
+		friend constexpr auto operator==(const char_class& lhs, const char_class& rhs) noexcept -> bool = default;
+
+	 private:
+		constexpr auto set_range(unsigned lo, unsigned hi) noexcept -> void {
+			for (auto byte = lo; byte <= hi; ++byte) {
+				bits[byte >> 6U] |= std::uint64_t{1} << (byte & 63U);
+			}
+		}
+		static constexpr auto starts_with(const char* p, const char* prefix) noexcept -> bool {
+			for (; *prefix != '\0'; ++p, ++prefix) {
+				if (*p != *prefix) {
+					return false;
+				}
+			}
+			return true;
+		}
+		static constexpr auto hex_digit(char c) -> unsigned {
+			if (c >= '0' and c <= '9') {
+				return static_cast<unsigned>(c - '0');
+			}
+			if (c >= 'a' and c <= 'f') {
+				return static_cast<unsigned>(c - 'a' + 10);
+			}
+			if (c >= 'A' and c <= 'F') {
+				return static_cast<unsigned>(c - 'A' + 10);
+			}
+			throw std::invalid_argument("char_class: invalid \\x escape");
+		}
+		static constexpr auto parse_char(const char*& p) -> unsigned {
+			if (*p == '\0') {
+				throw std::invalid_argument("char_class: unterminated bracket expression");
+			}
+			if (*p != '\\') {
+				return static_cast<unsigned char>(*p++);
+			}
+			++p;
+			switch (const auto escaped = *p++; escaped) {
+			case '\0': throw std::invalid_argument("char_class: trailing backslash");
+			case 'n': return '\n';
+			case 't': return '\t';
+			case 'r': return '\r';
+			case 'f': return '\f';
+			case 'v': return '\v';
+			case '0': return 0;
+			case 'x': {
+				const auto high = hex_digit(*p);
+				const auto low = hex_digit(p[1]);
+				p += 2;
+				return high * 16 + low;
+			}
+			default: return static_cast<unsigned char>(escaped);
+			}
+		}
+		constexpr auto parse_named(const char*& p) -> void {
+			struct named {
+				const char* name;
+				unsigned ranges[4][2];
+			};
+			constexpr named classes[] = {
+			    {"[:alpha:]", {{'A', 'Z'}, {'a', 'z'}, {1, 0}, {1, 0}}},
+			    {"[:digit:]", {{'0', '9'}, {1, 0}, {1, 0}, {1, 0}}},
+			    {"[:alnum:]", {{'0', '9'}, {'A', 'Z'}, {'a', 'z'}, {1, 0}}},
+			    {"[:upper:]", {{'A', 'Z'}, {1, 0}, {1, 0}, {1, 0}}},
+			    {"[:lower:]", {{'a', 'z'}, {1, 0}, {1, 0}, {1, 0}}},
+			    {"[:space:]", {{'\t', '\r'}, {' ', ' '}, {1, 0}, {1, 0}}},
+			    {"[:blank:]", {{'\t', '\t'}, {' ', ' '}, {1, 0}, {1, 0}}},
+			    {"[:punct:]", {{'!', '/'}, {':', '@'}, {'[', '`'}, {'{', '~'}}},
+			    {"[:xdigit:]", {{'0', '9'}, {'A', 'F'}, {'a', 'f'}, {1, 0}}},
+			    {"[:cntrl:]", {{0, 31}, {127, 127}, {1, 0}, {1, 0}}},
+			    {"[:print:]", {{' ', '~'}, {1, 0}, {1, 0}, {1, 0}}},
+			    {"[:graph:]", {{'!', '~'}, {1, 0}, {1, 0}, {1, 0}}},
+			};
+			for (const auto& cls : classes) {
+				if (starts_with(p, cls.name)) {
+					for (const auto& range : cls.ranges) {
+						if (range[0] <= range[1]) {
+							set_range(range[0], range[1]);
+						}
+					}
+					p += std::char_traits<char>::length(cls.name);
+					return;
+				}
+			}
+			throw std::invalid_argument("char_class: unknown character class");
+		}
+		constexpr auto parse(const char* spec) -> void {
+			if (spec == nullptr or *spec != '[') {
+				throw std::invalid_argument("char_class: expression must start with '['");
+			}
+			auto p = spec + 1;
+			const auto negate = *p == '^';
+			if (negate) {
+				++p;
+			}
+			for (auto first = true; first or *p != ']'; first = false) {
+				if (starts_with(p, "[:")) {
+					parse_named(p);
+					continue;
+				}
+				const auto lo = parse_char(p);
+				if (*p == '-' and p[1] != ']' and p[1] != '\0') {
+					++p;
+					const auto hi = parse_char(p);
+					if (hi < lo) {
+						throw std::invalid_argument("char_class: range out of order");
+					}
+					set_range(lo, hi);
+				}
+				else {
+					set_range(lo, lo);
+				}
+			}
+			if (*++p != '\0') {
+				throw std::invalid_argument("char_class: trailing characters after ']'");
+			}
+			if (negate) {
+				*this = ~*this;
+			}
+		}
+
+		table_type bits;
+	};
+} // namespace fsv
+
+#endif // COMP6771_ASS2_CHAR_CLASS_H
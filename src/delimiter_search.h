@@ -0,0 +1,91 @@
+#ifndef COMP6771_ASS2_DELIMITER_SEARCH_H
+#define COMP6771_ASS2_DELIMITER_SEARCH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fsv::detail {
+	// Knuth-Morris-Pratt search for a delimiter in a sequence of accepted characters, fed one at a
+	// time together with the raw offset just past each. Only the offsets of the last
+	// delimiter.size() + 1 characters are kept, which is all split() needs to cut the piece before
+	// a match, so the text being searched is never copied.
+	class delimiter_search {
+	 public:
+		// With overlapping set, every occurrence is reported, including those that begin inside the
+		// previous one, and the caller picks which to cut at.
+		explicit delimiter_search(std::string delimiter, bool overlapping = false)
+		: delim(std::move(delimiter))
+		, failure(delim.size(), 0)
+		, ends(delim.size() + 1, 0)
+		, count(0)
+		, matched(0)
+		, overlapping(overlapping) {
+			for (std::size_t i = 1, k = 0; i < delim.size(); ++i) {
+				while (k > 0 and delim[i] != delim[k]) {
+					k = failure[k - 1];
+				}
+				if (delim[i] == delim[k]) {
+					++k;
+				}
+				failure[i] = k;
+			}
+		}
+		// Returns true when c completes a match. Unless overlapping is set, matches do not overlap.
+		// Must not be called with an empty delimiter.
+		auto feed(char c, std::size_t raw_end) -> bool {
+			ends[count++ % ends.size()] = raw_end;
+			while (matched > 0 and c != delim[matched]) {
+				matched = failure[matched - 1];
+			}
+			if (c == delim[matched] and ++matched == delim.size()) {
+				matched = overlapping ? failure[matched - 1] : 0;
+				return true;
+			}
+			return false;
+		}
+		[[nodiscard]] auto empty() const noexcept -> bool {
+			return delim.empty();
+		}
+		// Whether fewer characters than the delimiter has were fed, in which case split() returns
+		// the whole view.
+		[[nodiscard]] auto too_short() const noexcept -> bool {
+			return delim.empty() or count < delim.size();
+		}
+		// The raw offsets just past the character before the latest match, and just past the match.
+		[[nodiscard]] auto piece_end() const noexcept -> std::size_t {
+			return end_of(count - delim.size());
+		}
+		[[nodiscard]] auto match_end() const noexcept -> std::size_t {
+			return end_of(count);
+		}
+		// Forgets every character fed so far, as if the search had just been constructed.
+		auto reset() noexcept -> void {
+			std::fill(ends.begin(), ends.end(), 0);
+			count = 0;
+			matched = 0;
+		}
+		// Moves the remembered offsets n bytes back, for when the buffer they index is shifted.
+		auto shift(std::size_t n) noexcept -> void {
+			for (auto& end : ends) {
+				end = end >= n ? end - n : 0;
+			}
+		}
+
+	 private:
+		[[nodiscard]] auto end_of(std::size_t k) const noexcept -> std::size_t {
+			return k == 0 ? 0 : ends[(k - 1) % ends.size()];
+		}
+
+		std::string delim;
+		std::vector<std::size_t> failure;
+		std::vector<std::size_t> ends;
+		std::size_t count;
+		std::size_t matched;
+		bool overlapping;
+	};
+} // namespace fsv::detail
+
+#endif // COMP6771_ASS2_DELIMITER_SEARCH_H
@@ -1,39 +1,114 @@
 #include "./filtered_string_view.h"
+#include "./acceptance_index.h"
+#include "./delimiter_search.h"
+#include "./index_file.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sys/uio.h>
+#include <system_error>
 
 namespace fsv {
+	namespace {
+		// Yields the accepted characters of a buffer in order, refilling one block at a time.
+		class accepted_chars {
+		 public:
+			accepted_chars(const char* ptr,
+			               std::size_t length,
+			               const filter& pred,
+			               detail::index_window window) noexcept
+			: ptr(ptr)
+			, length(length)
+			, scan(pred)
+			, window(window)
+			, offset(0)
+			, base(0)
+			, last(0)
+			, bits(0) {}
+			auto next(char& c) -> bool {
+				while (bits == 0) {
+					if (offset >= length) {
+						return false;
+					}
+					const auto n = std::min(detail::block_size, length - offset);
+					bits = window ? window.word_at(offset) : scan.mask(ptr + offset, n);
+					base = offset;
+					offset += n;
+				}
+				last = base + static_cast<std::size_t>(std::countr_zero(bits));
+				c = ptr[last];
+				bits &= bits - 1;
+				return true;
+			}
+			// The raw offset of the character last returned by next().
+			[[nodiscard]] auto position() const noexcept -> std::size_t {
+				return last;
+			}
+
+		 private:
+			const char* ptr;
+			std::size_t length;
+			detail::scanner scan;
+			detail::index_window window;
+			std::size_t offset;
+			std::size_t base;
+			std::size_t last;
+			std::uint64_t bits;
+		};
+		auto default_filter() -> const filter& {
+			static const auto pred = filter(default_predicate);
+			return pred;
+		}
+	} // namespace
+	block_filter::block_filter(mask_function mask) noexcept
+	: mask_fn(std::move(mask)) {}
+	auto block_filter::operator()(const char& c) const -> bool {
+		return (mask_fn(&c, 1) & 1U) != 0;
+	}
+	auto block_filter::mask(const char* block, std::size_t n) const -> std::uint64_t {
+		return mask_fn(block, n);
+	}
 	filtered_string_view::filtered_string_view() noexcept
 	: ptr(nullptr)
 	, str_length(0)
-	, str_pred(default_predicate) {}
+	, str_state() {}
 	filtered_string_view::filtered_string_view(const std::string& str, filter predicate) noexcept
 	: ptr(str.data())
 	, str_length(str.size())
-	, str_pred(predicate) {}
+	, str_state(std::make_shared<const detail::view_state>(std::move(predicate))) {}
 	filtered_string_view::filtered_string_view(const char* str, filter predicate) noexcept
 	: ptr(str)
 	, str_length(std::strlen(str))
-	, str_pred(predicate) {}
+	, str_state(std::make_shared<const detail::view_state>(std::move(predicate))) {}
 	filtered_string_view::filtered_string_view(const filtered_string_view& other) noexcept
 	: ptr(other.ptr)
 	, str_length(other.str_length)
-	, str_pred(other.str_pred) {}
+	, str_state(other.str_state) {}
 	filtered_string_view::filtered_string_view(filtered_string_view&& other) noexcept
 	: ptr(other.ptr)
 	, str_length(other.str_length)
-	, str_pred(std::move(other.str_pred)) {
+	, str_state(std::move(other.str_state)) {
 		other.ptr = nullptr;
 		other.str_length = 0;
-		other.str_pred = default_predicate;
 	}
 	filtered_string_view::filtered_string_view(const char* str, std::size_t str_len, filter predicate) noexcept
 	: ptr(str)
 	, str_length(str_len)
-	, str_pred(predicate) {}
+	, str_state(std::make_shared<const detail::view_state>(std::move(predicate))) {}
+	filtered_string_view::filtered_string_view(const char* str,
+	                                           std::size_t str_len,
+	                                           std::shared_ptr<const detail::view_state> state) noexcept
+	: ptr(str)
+	, str_length(str_len)
+	, str_state(std::move(state)) {}
 	auto filtered_string_view::operator=(const filtered_string_view& other) -> filtered_string_view& {
 		if (this != &other) {
 			ptr = other.ptr;
 			str_length = other.str_length;
-			str_pred = other.str_pred;
+			str_state = other.str_state;
 		}
 		return *this;
 	}
@@ -41,36 +116,72 @@ namespace fsv {
 		if (this != &other) {
 			ptr = other.ptr;
 			str_length = other.str_length;
-			str_pred = std::move(other.str_pred);
+			str_state = std::move(other.str_state);
 			other.ptr = nullptr;
 			other.str_length = 0;
-			other.str_pred = default_predicate;
 		}
 		return *this;
 	}
 	filtered_string_view::~filtered_string_view() {}
 	auto filtered_string_view::at(std::size_t n) const -> const char& {
-		std::size_t index = 0;
-		for (std::size_t i = 0; i < str_length; i++) {
-			if (str_pred(ptr[i])) {
-				if (index == n) {
-					return ptr[i];
+		auto found = static_cast<const char*>(nullptr);
+		auto scan_from = [this, &found](std::size_t start, std::size_t remaining) {
+			auto visit = [&](std::size_t offset, std::uint64_t bits) {
+				if (const auto accepted = detail::popcount(bits); remaining >= accepted) {
+					remaining -= accepted;
+					return true;
 				}
-				index++;
+				found = ptr + start + offset + detail::select_bit(bits, remaining);
+				return false;
+			};
+			detail::for_each_block(ptr + start, str_length - start, predicate(), visit);
+		};
+		if (const auto window = index_window()) {
+			found = n < window.count() ? ptr + window.select(n) : nullptr;
+		}
+		else if (const auto* index = large() ? str_state->advance(ptr, str_length) : nullptr) {
+			// Positions inside the part indexed so far are selected; the rest of the buffer is scanned.
+			if (const auto prefix = index->prefix(); n < prefix.count) {
+				found = ptr + index->select(n);
 			}
+			else {
+				scan_from(prefix.length, n - prefix.count);
+			}
+		}
+		else {
+			scan_from(0, n);
 		}
-		throw std::domain_error("filtered_string_view::at(" + std::to_string(n) + "): invalid index");
+		if (found == nullptr) {
+			throw std::domain_error("filtered_string_view::at(" + std::to_string(n) + "): invalid index");
+		}
+		return *found;
 	}
 	auto filtered_string_view::operator[](std::size_t n) const -> const char& {
 		return this->at(n);
 	}
 	auto filtered_string_view::size() const -> std::size_t {
-		std::size_t count = 0;
-		for (std::size_t i = 0; i < str_length; i++) {
-			if (str_pred(ptr[i])) {
-				count++;
-			}
+		if (not str_state) {
+			return 0;
+		}
+		if (const auto cached = str_state->cached_size()) {
+			return *cached;
+		}
+		if (const auto window = index_window()) {
+			return window.count();
+		}
+		auto prefix = detail::index_prefix{0, 0};
+		if (const auto* index = large() ? str_state->advance(ptr, str_length) : nullptr) {
+			prefix = index->prefix();
 		}
+		auto count = prefix.count;
+		detail::for_each_block(ptr + prefix.length,
+		                       str_length - prefix.length,
+		                       predicate(),
+		                       [&count](std::size_t, std::uint64_t bits) {
+			                       count += detail::popcount(bits);
+			                       return true;
+		                       });
+		str_state->publish_size(count);
 		return count;
 	}
 	auto filtered_string_view::empty() const -> bool {
@@ -80,117 +191,406 @@ namespace fsv {
 		return ptr;
 	}
 	auto filtered_string_view::predicate() const -> const filter& {
-		return str_pred;
+		return str_state ? str_state->predicate() : default_filter();
 	}
 	filtered_string_view::operator std::string() const {
 		std::string conversion;
-		conversion.reserve(str_length);
-		for (std::size_t i = 0; i < str_length; i++) {
-			if (str_pred(ptr[i])) {
-				conversion.push_back(ptr[i]);
-			}
-		}
-		return conversion;
-	}
-	auto compose(const filtered_string_view& fsv, const std::vector<filter>& filts) -> filtered_string_view {
-		auto composed = [filts](const char& input_char) {
-			for (const auto& filt : filts) {
-				if (not filt(input_char)) {
-					return false;
-				}
+		const auto window = index_window();
+		conversion.reserve(window ? window.count() : str_length);
+		auto append = [&](std::size_t offset, std::uint64_t bits) {
+			for (; bits != 0; bits &= bits - 1) {
+				conversion.push_back(ptr[offset + static_cast<std::size_t>(std::countr_zero(bits))]);
 			}
 			return true;
 		};
-		return filtered_string_view(fsv.data(), composed);
+		detail::for_each_block(ptr, str_length, predicate(), window, append);
+		return conversion;
 	}
-	auto operator==(const filtered_string_view& lhs, const filtered_string_view& rhs) -> bool {
-		if (lhs.size() != rhs.size()) {
+	auto filtered_string_view::raw_offset(std::size_t filtered_index) const -> std::size_t {
+		const auto window = indexed_window();
+		const auto accepted = window.count();
+		if (filtered_index > accepted) {
+			throw std::domain_error("filtered_string_view::raw_offset(" + std::to_string(filtered_index)
+			                        + "): invalid index");
+		}
+		return filtered_index == accepted ? str_length : window.select(filtered_index);
+	}
+	auto filtered_string_view::filtered_index(std::size_t raw_offset) const -> std::size_t {
+		if (raw_offset > str_length) {
+			throw std::domain_error("filtered_string_view::filtered_index(" + std::to_string(raw_offset)
+			                        + "): invalid offset");
+		}
+		return indexed_window().rank(raw_offset);
+	}
+	auto filtered_string_view::bitmap() const -> std::span<const std::uint64_t> {
+		return aligned_index().words();
+	}
+	auto filtered_string_view::index_in_background() const -> void {
+		if (str_state) {
+			str_state->build_in_background(ptr, str_length);
+		}
+	}
+	auto filtered_string_view::save_index(const std::string& sidecar_path,
+	                                      const std::string& source_path,
+	                                      std::string_view predicate_id) const -> void {
+		detail::save_sidecar(sidecar_path, source_path, predicate_id, aligned_index());
+	}
+	// A sidecar that is stale, for another predicate or for a buffer of a different length is
+	// ignored, and the index is built as usual when it is first needed.
+	auto filtered_string_view::attach_index(const std::string& sidecar_path,
+	                                        const std::string& source_path,
+	                                        std::string_view predicate_id) const -> bool {
+		auto index = str_state ? detail::load_sidecar(sidecar_path, source_path, predicate_id) : nullptr;
+		if (not index or index->length() != str_length) {
 			return false;
 		}
-		for (std::size_t i = 0; i < rhs.size(); i++) {
-			if (lhs[i] != rhs[i]) {
-				return false;
+		str_state->adopt(std::move(index));
+		return true;
+	}
+	auto filtered_string_view::index_stats() const -> index_info {
+		return str_state ? str_state->stats() : index_info{index_kind::none, 0};
+	}
+	auto filtered_string_view::aligned_index() const -> const detail::acceptance_index& {
+		static const auto empty = detail::acceptance_index(0);
+		return str_state ? str_state->aligned_index(ptr, str_length) : empty;
+	}
+	auto filtered_string_view::large() const -> bool {
+		return str_state and str_length >= detail::index_threshold;
+	}
+	auto filtered_string_view::index_window() const -> detail::index_window {
+		return str_state ? str_state->window(str_length) : detail::index_window();
+	}
+	auto filtered_string_view::indexed_window() const -> detail::index_window {
+		return str_state ? str_state->ensure_window(ptr, str_length) : detail::index_window();
+	}
+	auto filtered_string_view::slice(std::size_t raw_from, std::size_t raw_to) const -> filtered_string_view {
+		return filtered_string_view(ptr + raw_from, raw_to - raw_from, detail::view_state::child(str_state, raw_from));
+	}
+	namespace {
+		// A conjunction accepts the same bytes whatever the order of its leaves, and byte tables have
+		// no side effects, so every char_class leaf is folded into a single table. It is kept first,
+		// so the other leaves are only called on the bytes it accepts.
+		auto push_leaf(std::vector<filter>& leaves, const filter& leaf) -> void {
+			const auto* table = leaf.target<char_class>();
+			if (table == nullptr) {
+				leaves.push_back(leaf);
+			}
+			else if (auto* first = leaves.empty() ? nullptr : leaves.front().target<char_class>()) {
+				*first = *first & *table;
+			}
+			else {
+				leaves.push_back(leaf);
+				std::rotate(leaves.begin(), leaves.end() - 1, leaves.end());
 			}
 		}
-		return true;
+		// Nested compositions are spliced into a single flat list so that evaluating a
+		// composed predicate never recurses, no matter how many times it was composed.
+		auto append_leaves(std::vector<filter>& leaves, const filter& filt) -> void {
+			if (const auto* nested = filt.target<detail::conjunction>()) {
+				for (const auto& leaf : nested->leaves()) {
+					push_leaf(leaves, leaf);
+				}
+			}
+			else if (not filt.target<detail::always_true>()) {
+				push_leaf(leaves, filt);
+			}
+		}
+	} // namespace
+	auto compose(const filtered_string_view& fsv, const std::vector<filter>& filts) -> filtered_string_view {
+		auto leaves = std::vector<filter>{};
+		append_leaves(leaves, fsv.predicate());
+		for (const auto& filt : filts) {
+			append_leaves(leaves, filt);
+		}
+		if (leaves.empty()) {
+			return filtered_string_view(fsv.ptr, fsv.str_length);
+		}
+		if (leaves.size() == 1) {
+			return filtered_string_view(fsv.ptr, fsv.str_length, leaves.front());
+		}
+		return filtered_string_view(fsv.ptr, fsv.str_length, detail::conjunction(std::move(leaves)));
+	}
+	namespace {
+		auto require_same_buffer(const char* name,
+		                         const char* lhs_ptr,
+		                         std::size_t lhs_length,
+		                         const char* rhs_ptr,
+		                         std::size_t rhs_length) -> void {
+			if (lhs_ptr != rhs_ptr or lhs_length != rhs_length) {
+				throw std::domain_error(std::string(name) + ": views do not share the same buffer");
+			}
+		}
+		// Predicates that are not both tables are combined a block at a time, so scans keep reading
+		// tables and block_filters a block at a time. The right-hand predicate is only evaluated on
+		// the bytes that decide the result, as with the short-circuiting operators.
+		template<typename TableOp, typename MaskOp>
+		auto combine_predicates(const filter& lhs, const filter& rhs, TableOp table_op, MaskOp mask_op) -> filter {
+			const auto* lhs_table = lhs.target<char_class>();
+			const auto* rhs_table = rhs.target<char_class>();
+			if (lhs_table != nullptr and rhs_table != nullptr) {
+				return table_op(*lhs_table, *rhs_table);
+			}
+			return block_filter([lhs, rhs, mask_op](const char* block, std::size_t n) {
+				return mask_op(lhs, rhs, block, n);
+			});
+		}
+	} // namespace
+	auto intersect(const filtered_string_view& lhs, const filtered_string_view& rhs) -> filtered_string_view {
+		require_same_buffer("fsv::intersect", lhs.ptr, lhs.str_length, rhs.ptr, rhs.str_length);
+		auto pred = combine_predicates(
+		    lhs.predicate(),
+		    rhs.predicate(),
+		    [](const char_class& l, const char_class& r) { return l & r; },
+		    [](const filter& l, const filter& r, const char* block, std::size_t n) {
+			    return detail::mask_of(r, block, n, detail::mask_of(l, block, n, detail::low_bits(n)));
+		    });
+		// The indexes are combined in their compressed form; no predicate is called.
+		auto index = detail::acceptance_index::intersect(lhs.aligned_index(), rhs.aligned_index());
+		return filtered_string_view(lhs.ptr,
+		                            lhs.str_length,
+		                            std::make_shared<const detail::view_state>(std::move(pred), std::move(index)));
+	}
+	auto unite(const filtered_string_view& lhs, const filtered_string_view& rhs) -> filtered_string_view {
+		require_same_buffer("fsv::unite", lhs.ptr, lhs.str_length, rhs.ptr, rhs.str_length);
+		auto pred = combine_predicates(
+		    lhs.predicate(),
+		    rhs.predicate(),
+		    [](const char_class& l, const char_class& r) { return l | r; },
+		    [](const filter& l, const filter& r, const char* block, std::size_t n) {
+			    const auto left = detail::mask_of(l, block, n, detail::low_bits(n));
+			    return left | detail::mask_of(r, block, n, detail::low_bits(n) & ~left);
+		    });
+		auto index = detail::acceptance_index::combine(lhs.aligned_index(), rhs.aligned_index(), std::bit_or<>());
+		return filtered_string_view(lhs.ptr,
+		                            lhs.str_length,
+		                            std::make_shared<const detail::view_state>(std::move(pred), std::move(index)));
+	}
+	auto subtract(const filtered_string_view& lhs, const filtered_string_view& rhs) -> filtered_string_view {
+		require_same_buffer("fsv::subtract", lhs.ptr, lhs.str_length, rhs.ptr, rhs.str_length);
+		auto pred = combine_predicates(
+		    lhs.predicate(),
+		    rhs.predicate(),
+		    [](const char_class& l, const char_class& r) { return l & ~r; },
+		    [](const filter& l, const filter& r, const char* block, std::size_t n) {
+			    const auto left = detail::mask_of(l, block, n, detail::low_bits(n));
+			    return left & ~detail::mask_of(r, block, n, left);
+		    });
+		auto index = detail::acceptance_index::combine(lhs.aligned_index(),
+		                                               rhs.aligned_index(),
+		                                               [](std::uint64_t l, std::uint64_t r) { return l & ~r; });
+		return filtered_string_view(lhs.ptr,
+		                            lhs.str_length,
+		                            std::make_shared<const detail::view_state>(std::move(pred), std::move(index)));
+	}
+	auto classify(const char* data, std::size_t length, const std::vector<filter>& filts)
+	    -> std::vector<filtered_string_view> {
+		auto indexes = detail::acceptance_index::build_all(data, length, filts);
+		auto views = std::vector<filtered_string_view>{};
+		views.reserve(filts.size());
+		for (std::size_t i = 0; i < filts.size(); ++i) {
+			auto state = std::make_shared<const detail::view_state>(filts[i], std::move(indexes[i]));
+			views.push_back(filtered_string_view(data, length, std::move(state)));
+		}
+		return views;
+	}
+	auto operator==(const filtered_string_view& lhs, const filtered_string_view& rhs) -> bool {
+		return (lhs <=> rhs) == std::strong_ordering::equal;
 	}
 	auto operator<=>(const filtered_string_view& lhs, const filtered_string_view& rhs) -> std::strong_ordering {
-		std::size_t lhs_size = lhs.size();
-		std::size_t rhs_size = rhs.size();
-		for (std::size_t i = 0; i < std::min(lhs_size, rhs_size); i++) {
-			if (auto cmp = lhs[i] <=> rhs[i]; cmp != std::strong_ordering::equal) {
+		auto lhs_chars = accepted_chars(lhs.ptr, lhs.str_length, lhs.predicate(), lhs.index_window());
+		auto rhs_chars = accepted_chars(rhs.ptr, rhs.str_length, rhs.predicate(), rhs.index_window());
+		char lhs_c = '\0';
+		char rhs_c = '\0';
+		while (true) {
+			const auto lhs_more = lhs_chars.next(lhs_c);
+			const auto rhs_more = rhs_chars.next(rhs_c);
+			if (not lhs_more or not rhs_more) {
+				return lhs_more <=> rhs_more;
+			}
+			if (auto cmp = lhs_c <=> rhs_c; cmp != std::strong_ordering::equal) {
 				return cmp;
 			}
 		}
-		return lhs_size <=> rhs_size;
 	}
 	auto operator<<(std::ostream& os, const filtered_string_view& fsv) -> std::ostream& {
-		for (std::size_t i = 0; i < fsv.size(); i++) {
-			os << fsv[i];
-		}
+		auto print = [&](std::size_t offset, std::uint64_t bits) {
+			for (; bits != 0; bits &= bits - 1) {
+				os.put(fsv.ptr[offset + static_cast<std::size_t>(std::countr_zero(bits))]);
+			}
+			return true;
+		};
+		detail::for_each_block(fsv.ptr, fsv.str_length, fsv.predicate(), fsv.index_window(), print);
 		return os;
 	}
+	namespace {
+		// Batches runs of bytes into writev() calls. Runs shorter than staged_run are copied into a
+		// staging buffer, where neighbouring runs merge into a single entry, so that a fragmented view
+		// does not cost one entry per accepted byte.
+		class gather_writer {
+		 public:
+			static constexpr auto staged_run = std::size_t{64};
+			static constexpr auto staging_size = std::size_t{1} << 16U;
+			static constexpr auto max_vectors = std::size_t{IOV_MAX < 1024 ? IOV_MAX : 1024};
+
+			explicit gather_writer(int fd) noexcept
+			: fd(fd)
+			, vectors()
+			, staging()
+			, staged(0)
+			, written(0) {}
+			auto add(const char* data, std::size_t length) -> void {
+				if (length >= staged_run) {
+					vectors.push_back(::iovec{const_cast<char*>(data), length});
+				}
+				else {
+					if (staged + length > staging.size()) {
+						flush();
+						staging.resize(staging_size);
+					}
+					auto* target = staging.data() + staged;
+					std::memcpy(target, data, length);
+					staged += length;
+					if (last_ends_at(target)) {
+						vectors.back().iov_len += length;
+					}
+					else {
+						vectors.push_back(::iovec{target, length});
+					}
+				}
+				if (vectors.size() == max_vectors) {
+					flush();
+				}
+			}
+			// Retries interrupted and partial writes until every batched byte is out.
+			auto flush() -> void {
+				auto* next = vectors.data();
+				auto left = vectors.size();
+				while (left > 0) {
+					const auto n = ::writev(fd, next, static_cast<int>(left));
+					if (n < 0) {
+						if (errno == EINTR) {
+							continue;
+						}
+						throw std::system_error(errno, std::generic_category(), "fsv::write_to");
+					}
+					written += static_cast<std::size_t>(n);
+					auto done = static_cast<std::size_t>(n);
+					for (; left > 0 and done >= next->iov_len; ++next, --left) {
+						done -= next->iov_len;
+					}
+					if (left > 0) {
+						next->iov_base = static_cast<char*>(next->iov_base) + done;
+						next->iov_len -= done;
+					}
+				}
+				vectors.clear();
+				staged = 0;
+			}
+			[[nodiscard]] auto total() const noexcept -> std::size_t {
+				return written;
+			}
+
+		 private:
+			[[nodiscard]] auto last_ends_at(const char* target) const noexcept -> bool {
+				if (vectors.empty()) {
+					return false;
+				}
+				return static_cast<char*>(vectors.back().iov_base) + vectors.back().iov_len == target;
+			}
+
+			int fd;
+			std::vector<::iovec> vectors;
+			std::vector<char> staging;
+			std::size_t staged;
+			std::size_t written;
+		};
+	} // namespace
+	auto write_to(int fd, const filtered_string_view& fsv) -> std::size_t {
+		auto writer = gather_writer(fd);
+		auto run_start = std::size_t{0};
+		auto run_end = std::size_t{0};
+		auto visit = [&](std::size_t offset, std::uint64_t bits) {
+			while (bits != 0) {
+				const auto first = static_cast<std::size_t>(std::countr_zero(bits));
+				const auto length = static_cast<std::size_t>(std::countr_one(bits >> first));
+				if (offset + first != run_end) {
+					if (run_end != run_start) {
+						writer.add(fsv.ptr + run_start, run_end - run_start);
+					}
+					run_start = offset + first;
+				}
+				run_end = offset + first + length;
+				bits &= ~detail::low_bits(first + length);
+			}
+			return true;
+		};
+		detail::for_each_block(fsv.ptr, fsv.str_length, fsv.predicate(), fsv.index_window(), visit);
+		if (run_end != run_start) {
+			writer.add(fsv.ptr + run_start, run_end - run_start);
+		}
+		writer.flush();
+		return writer.total();
+	}
+	// Searches the indexed characters in place, so the filtered text is never copied out.
 	auto split(const filtered_string_view& fsv, const filtered_string_view& tok) -> std::vector<filtered_string_view> {
 		std::vector<filtered_string_view> result;
-		if (tok.empty() or fsv.empty() or fsv.size() < tok.size()) {
+		auto search = detail::delimiter_search(static_cast<std::string>(tok));
+		if (search.empty()) {
 			result.push_back(fsv);
 			return result;
 		}
-		std::size_t offset = 0;
-		std::size_t end = fsv.size();
-		std::size_t tok_size = tok.size();
-		for (std::size_t i = 0; i <= end - tok_size;) {
-			bool match = true;
-			for (std::size_t j = 0; j < tok_size; j++) {
-				if (fsv.at(i + j) != tok.at(j)) {
-					match = false;
-					break;
-				}
-			}
-			if (match) {
-				filtered_string_view temp(
-				    fsv.data() + offset + fsv.count_filtered_chars_before(offset),
-				    i - offset + fsv.count_filtered_chars_before(i) - fsv.count_filtered_chars_before(offset),
-				    fsv.predicate());
-				result.push_back(temp);
-				offset = i + tok_size;
-				i = offset;
-			}
-			else {
-				i++;
+		auto chars = accepted_chars(fsv.ptr, fsv.str_length, fsv.predicate(), fsv.indexed_window());
+		auto raw_from = std::size_t{0};
+		for (auto c = char{}; chars.next(c);) {
+			if (search.feed(c, chars.position() + 1)) {
+				result.push_back(fsv.slice(raw_from, search.piece_end()));
+				raw_from = search.match_end();
 			}
 		}
-		if (offset <= end) {
-			filtered_string_view temp(
-			    fsv.data() + offset + fsv.count_filtered_chars_before(offset),
-			    end - offset + fsv.count_filtered_chars_before(end) - fsv.count_filtered_chars_before(offset),
-			    fsv.predicate());
-			result.push_back(temp);
+		if (search.too_short()) {
+			result.push_back(fsv);
+			return result;
 		}
+		result.push_back(fsv.slice(raw_from, search.match_end()));
 		return result;
 	}
 	auto filtered_string_view::count_filtered_chars_before(std::size_t index) const -> std::size_t {
-		std::size_t filtered_count = 0;
-		std::size_t raw_index = 0;
-		for (std::size_t i = 0; i < str_length && raw_index < index; ++i) {
-			if (!str_pred(ptr[i])) {
-				filtered_count++;
-			}
-			else {
-				raw_index++;
-			}
+		if (index == 0) {
+			return 0;
+		}
+		if (const auto window = index_window()) {
+			const auto accepted = window.count();
+			return index <= accepted ? window.boundary(index) - index : str_length - accepted;
 		}
-		return filtered_count;
+		auto accepted_before = std::size_t{0};
+		auto filtered_count = std::optional<std::size_t>{};
+		detail::for_each_block(ptr, str_length, predicate(), [&](std::size_t offset, std::uint64_t bits) {
+			if (const auto accepted = detail::popcount(bits); accepted_before + accepted < index) {
+				accepted_before += accepted;
+				return true;
+			}
+			filtered_count = offset + detail::select_bit(bits, index - 1 - accepted_before) + 1 - index;
+			return false;
+		});
+		return filtered_count.value_or(str_length - accepted_before);
 	}
 	auto substr(const filtered_string_view& fsv, std::size_t pos, std::size_t count) -> filtered_string_view {
-		if (pos >= fsv.size()) {
+		if (fsv.index_window() or fsv.str_length >= detail::index_threshold) {
+			const auto window = fsv.indexed_window();
+			const auto size = window.count();
+			if (pos >= size) {
+				return filtered_string_view("", fsv.predicate());
+			}
+			const auto rcount = (count <= 0) ? size - pos : std::min(count, size - pos);
+			return fsv.slice(window.boundary(pos), window.boundary(pos + rcount));
+		}
+		const auto size = fsv.size();
+		if (pos >= size) {
 			return filtered_string_view("", fsv.predicate());
 		}
-		std::size_t rcount = (count <= 0) ? fsv.size() - pos : count;
-		const char* start_ptr = fsv.data() + pos + fsv.count_filtered_chars_before(pos);
-		std::size_t original_length =
-		    rcount + fsv.count_filtered_chars_before(pos + rcount) - fsv.count_filtered_chars_before(pos);
-		return filtered_string_view(start_ptr, original_length, fsv.predicate());
+		const auto rcount = (count <= 0) ? size - pos : std::min(count, size - pos);
+		return fsv.slice(pos + fsv.count_filtered_chars_before(pos),
+		                 pos + rcount + fsv.count_filtered_chars_before(pos + rcount));
 	}
 	filtered_string_view::iter::iter() noexcept
 	: fsv(nullptr)
@@ -222,6 +622,19 @@ namespace fsv {
 		--(*this);
 		return tmp;
 	}
+	// Positions are filtered indices, so moving is constant time; dereferencing goes through at(),
+	// which is a select query once the view is indexed.
+	auto filtered_string_view::iter::operator+=(difference_type n) -> iter& {
+		pos += static_cast<std::size_t>(n);
+		return *this;
+	}
+	auto filtered_string_view::iter::operator-=(difference_type n) -> iter& {
+		pos -= static_cast<std::size_t>(n);
+		return *this;
+	}
+	auto filtered_string_view::iter::operator[](difference_type n) const -> reference {
+		return fsv->at(pos + static_cast<std::size_t>(n));
+	}
 	filtered_string_view::const_iter::const_iter() noexcept
 	: fsv(nullptr)
 	, pos(0) {}
@@ -252,6 +665,17 @@ namespace fsv {
 		--(*this);
 		return tmp;
 	}
+	auto filtered_string_view::const_iter::operator+=(difference_type n) -> const_iter& {
+		pos += static_cast<std::size_t>(n);
+		return *this;
+	}
+	auto filtered_string_view::const_iter::operator-=(difference_type n) -> const_iter& {
+		pos -= static_cast<std::size_t>(n);
+		return *this;
+	}
+	auto filtered_string_view::const_iter::operator[](difference_type n) const -> reference {
+		return fsv->at(pos + static_cast<std::size_t>(n));
+	}
 	auto filtered_string_view::begin() const -> iterator {
 		return iterator(this, 0);
 	}
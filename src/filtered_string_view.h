@@ -1,25 +1,63 @@
 #ifndef COMP6771_ASS2_FSV_H
 #define COMP6771_ASS2_FSV_H
 
+#include "./char_class.h"
+
 #include <compare>
+#include <cstdint>
 #include <cstring>
 #include <functional>
 #include <iostream>
 #include <iterator>
+#include <memory>
 #include <optional>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <vector>
 
+namespace fsv::detail {
+	struct always_true {
+		constexpr auto operator()(const char&) const noexcept -> bool {
+			return true;
+		}
+	};
+	class acceptance_index;
+	class index_window;
+	class view_state;
+} // namespace fsv::detail
 namespace {
 	using filter = std::function<bool(const char&)>;
-	auto default_predicate = [](const char&) noexcept -> bool { return true; };
+	constexpr auto default_predicate = fsv::detail::always_true{};
 } // namespace
 namespace fsv {
 	using filter = std::function<bool(const char&)>;
+	class thread_pool;
+	// A predicate that classifies up to 64 bytes per call: bit i of mask(block, n) is set when block[i]
+	// is accepted. Wrapping one in a filter lets every scan drive it block by block.
+	class block_filter {
+	 public:
+		using mask_function = std::function<std::uint64_t(const char*, std::size_t)>;
+		explicit block_filter(mask_function mask) noexcept;
+		auto operator()(const char& c) const -> bool;
+		[[nodiscard]] auto mask(const char* block, std::size_t n) const -> std::uint64_t;
+
+	 private:
+		mask_function mask_fn;
+	};
+	// How a view's index stores the accepted positions, chosen when it is built from the measured
+	// selectivity: a bitmap with rank blocks, a sorted array of accepted offsets, or a list of runs.
+	// Each 64 KiB chunk chooses separately; an index whose chunks disagree is mixed.
+	enum class index_kind { none, bitmap, offsets, runs, mixed };
+	struct index_info {
+		index_kind kind;
+		std::size_t bytes;
+	};
 	class filtered_string_view {
 		class iter {
 		 public:
-			using iterator_category = std::bidirectional_iterator_tag;
+			using iterator_category = std::random_access_iterator_tag;
 			using value_type = char;
 			using difference_type = std::ptrdiff_t;
 			using pointer = const char*;
@@ -32,9 +70,27 @@ namespace fsv {
 			auto operator++(int) -> iter;
 			auto operator--() -> iter&;
 			auto operator--(int) -> iter;
+			auto operator+=(difference_type n) -> iter&;
+			auto operator-=(difference_type n) -> iter&;
+			auto operator[](difference_type n) const -> reference;
+			friend auto operator+(iter it, difference_type n) -> iter {
+				return it += n;
+			}
+			friend auto operator+(difference_type n, iter it) -> iter {
+				return it += n;
+			}
+			friend auto operator-(iter it, difference_type n) -> iter {
+				return it -= n;
+			}
+			friend auto operator-(const iter& lhs, const iter& rhs) -> difference_type {
+				return static_cast<difference_type>(lhs.pos) - static_cast<difference_type>(rhs.pos);
+			}
 			friend auto operator==(const iter& lhs, const iter& rhs) -> bool {
 				return lhs.fsv == rhs.fsv and lhs.pos == rhs.pos;
 			}
+			friend auto operator<=>(const iter& lhs, const iter& rhs) -> std::strong_ordering {
+				return lhs.pos <=> rhs.pos;
+			}
 			friend auto operator!=(const iter& lhs, const iter& rhs) -> bool {
 				return !(lhs == rhs);
 			}
@@ -45,7 +101,7 @@ namespace fsv {
 		};
 		class const_iter {
 		 public:
-			using iterator_category = std::bidirectional_iterator_tag;
+			using iterator_category = std::random_access_iterator_tag;
 			using value_type = char;
 			using difference_type = std::ptrdiff_t;
 			using pointer = const char*;
@@ -58,9 +114,27 @@ namespace fsv {
 			auto operator++(int) -> const_iter;
 			auto operator--() -> const_iter&;
 			auto operator--(int) -> const_iter;
+			auto operator+=(difference_type n) -> const_iter&;
+			auto operator-=(difference_type n) -> const_iter&;
+			auto operator[](difference_type n) const -> reference;
+			friend auto operator+(const_iter it, difference_type n) -> const_iter {
+				return it += n;
+			}
+			friend auto operator+(difference_type n, const_iter it) -> const_iter {
+				return it += n;
+			}
+			friend auto operator-(const_iter it, difference_type n) -> const_iter {
+				return it -= n;
+			}
+			friend auto operator-(const const_iter& lhs, const const_iter& rhs) -> difference_type {
+				return static_cast<difference_type>(lhs.pos) - static_cast<difference_type>(rhs.pos);
+			}
 			friend auto operator==(const const_iter& lhs, const const_iter& rhs) -> bool {
 				return lhs.fsv == rhs.fsv and lhs.pos == rhs.pos;
 			}
+			friend auto operator<=>(const const_iter& lhs, const const_iter& rhs) -> std::strong_ordering {
+				return lhs.pos <=> rhs.pos;
+			}
 			friend auto operator!=(const const_iter& lhs, const const_iter& rhs) -> bool {
 				return !(lhs == rhs);
 			}
@@ -88,6 +162,20 @@ namespace fsv {
 		[[nodiscard]] auto predicate() const -> const filter&;
 		explicit operator std::string() const;
 		[[nodiscard]] auto count_filtered_chars_before(std::size_t index) const -> std::size_t;
+		[[nodiscard]] auto raw_offset(std::size_t filtered_index) const -> std::size_t;
+		[[nodiscard]] auto filtered_index(std::size_t raw_offset) const -> std::size_t;
+		[[nodiscard]] auto bitmap() const -> std::span<const std::uint64_t>;
+		[[nodiscard]] auto index_stats() const -> index_info;
+		// Finishes building the index on a background thread; queries meanwhile use the part built so far.
+		auto index_in_background() const -> void;
+		// Saves the index of a view over the contents of source_path, so that a later view over the
+		// unchanged file can attach it instead of rebuilding it. predicate_id names the predicate.
+		auto save_index(const std::string& sidecar_path,
+		                const std::string& source_path,
+		                std::string_view predicate_id) const -> void;
+		auto attach_index(const std::string& sidecar_path,
+		                  const std::string& source_path,
+		                  std::string_view predicate_id) const -> bool;
 		using iterator = iter;
 		using const_iterator = const_iter;
 		using reverse_iterator = std::reverse_iterator<iterator>;
@@ -102,15 +190,56 @@ namespace fsv {
 		auto crend() const -> const_reverse_iterator;
 
 	 private:
+		friend class tail_view;
+		friend auto operator==(const filtered_string_view& lhs, const filtered_string_view& rhs) -> bool;
+		friend auto operator<=>(const filtered_string_view& lhs, const filtered_string_view& rhs)
+		    -> std::strong_ordering;
+		friend auto operator<<(std::ostream& os, const filtered_string_view& fsv) -> std::ostream&;
+		friend auto write_to(int fd, const filtered_string_view& fsv) -> std::size_t;
+		friend auto parallel_size(const filtered_string_view& fsv, thread_pool& pool) -> std::size_t;
+		friend auto parallel_string(const filtered_string_view& fsv, thread_pool& pool) -> std::string;
+		friend auto parallel_split(const filtered_string_view& fsv, const filtered_string_view& tok, thread_pool& pool)
+		    -> std::vector<filtered_string_view>;
+		friend auto compose(const filtered_string_view& fsv, const std::vector<filter>& filts) -> filtered_string_view;
+		friend auto intersect(const filtered_string_view& lhs, const filtered_string_view& rhs)
+		    -> filtered_string_view;
+		friend auto classify(const char* data, std::size_t length, const std::vector<filter>& filts)
+		    -> std::vector<filtered_string_view>;
+		friend auto split(const filtered_string_view& fsv, const filtered_string_view& tok)
+		    -> std::vector<filtered_string_view>;
+		friend auto substr(const filtered_string_view& fsv, std::size_t pos, std::size_t count) -> filtered_string_view;
+		friend auto unite(const filtered_string_view& lhs, const filtered_string_view& rhs) -> filtered_string_view;
+		friend auto subtract(const filtered_string_view& lhs, const filtered_string_view& rhs)
+		    -> filtered_string_view;
+		filtered_string_view(const char* str,
+		                     std::size_t str_len,
+		                     std::shared_ptr<const detail::view_state> state) noexcept;
+		[[nodiscard]] auto large() const -> bool;
+		[[nodiscard]] auto aligned_index() const -> const detail::acceptance_index&;
+		[[nodiscard]] auto index_window() const -> detail::index_window;
+		[[nodiscard]] auto indexed_window() const -> detail::index_window;
+		[[nodiscard]] auto slice(std::size_t raw_from, std::size_t raw_to) const -> filtered_string_view;
 		const char* ptr;
 		std::size_t str_length;
-		filter str_pred;
+		// Predicate, lazily built index and cached size; shared by copies and by slices.
+		std::shared_ptr<const detail::view_state> str_state;
 	};
 	[[nodiscard]] auto operator==(const filtered_string_view& lhs, const filtered_string_view& rhs) -> bool;
 	[[nodiscard]] auto operator<=>(const filtered_string_view& lhs, const filtered_string_view& rhs)
 	    -> std::strong_ordering;
 	auto operator<<(std::ostream& os, const filtered_string_view& fsv) -> std::ostream&;
+	// Writes the accepted characters to a file descriptor with writev(), one entry per run of
+	// accepted bytes; short runs are copied together into a staging buffer first. Returns the number
+	// of bytes written and throws std::system_error if a write fails.
+	auto write_to(int fd, const filtered_string_view& fsv) -> std::size_t;
 	[[nodiscard]] auto compose(const filtered_string_view& fsv, const std::vector<filter>& filts) -> filtered_string_view;
+	[[nodiscard]] auto intersect(const filtered_string_view& lhs, const filtered_string_view& rhs)
+	    -> filtered_string_view;
+	[[nodiscard]] auto unite(const filtered_string_view& lhs, const filtered_string_view& rhs) -> filtered_string_view;
+	[[nodiscard]] auto subtract(const filtered_string_view& lhs, const filtered_string_view& rhs)
+	    -> filtered_string_view;
+	[[nodiscard]] auto classify(const char* data, std::size_t length, const std::vector<filter>& filts)
+	    -> std::vector<filtered_string_view>;
 	[[nodiscard]] auto split(const filtered_string_view& fsv, const filtered_string_view& tok)
 	    -> std::vector<filtered_string_view>;
 	[[nodiscard]] auto substr(const filtered_string_view& fsv, std::size_t pos = 0, std::size_t count = 0)
@@ -1,9 +1,26 @@
 #include "./filtered_string_view.h"
+#include "./batch_filter.h"
+#include "./mapped_file.h"
+#include "./parallel.h"
+#include "./segmented_view.h"
+#include "./stream_filter.h"
+#include "./tail_view.h"
 
 #include <catch2/catch.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <set>
 #include <sstream>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 using namespace fsv;
@@ -112,6 +129,27 @@ TEST_CASE("Compose Function") {
 	REQUIRE(result == "c/c++");
 }
 
+TEST_CASE("Compose keeps the source predicate and length") {
+	auto digits_and_spaces = filtered_string_view{"a1 b2 c3", [](const char& c) { return c != ' '; }};
+	auto sv = compose(digits_and_spaces, {[](const char& c) { return std::isdigit(static_cast<unsigned char>(c)); }});
+	REQUIRE(static_cast<std::string>(sv) == "123");
+
+	// the slice is not null-terminated, so compose must not fall back to strlen()
+	auto slice = substr(filtered_string_view{"abcdef"}, 1, 3);
+	auto composed = compose(slice, {[](const char& c) { return c != 'c'; }});
+	REQUIRE(static_cast<std::string>(composed) == "bd");
+}
+
+TEST_CASE("Compose flattens nested compositions") {
+	auto sv = filtered_string_view{"abcdefgh"};
+	for (char banned = 'a'; banned < 'f'; ++banned) {
+		sv = compose(sv, {[banned](const char& c) { return c != banned; }});
+	}
+	REQUIRE(static_cast<std::string>(sv) == "fgh");
+	REQUIRE(sv.predicate()('g'));
+	REQUIRE(not sv.predicate()('c'));
+}
+
 TEST_CASE("Output Stream") {
 	auto fsv = filtered_string_view{"c++ > rust > java", [](const char& c) { return c == 'c' || c == '+'; }};
 	std::ostringstream test_os_stream;
@@ -229,4 +267,1050 @@ TEST_CASE("default_predicate returns true for all characters") {
 		REQUIRE(default_predicate(c));
 	}
 	REQUIRE(default_predicate(std::numeric_limits<char>::max()));
-}
\ No newline at end of file
+}
+TEST_CASE("char_class compiles bracket expressions at compile time") {
+	constexpr auto word = fsv::char_class{"[A-Za-z0-9_]"};
+	static_assert(word.contains('q') and word.contains('Z') and word.contains('7') and word.contains('_'));
+	static_assert(not word.contains('-') and not word.contains(' '));
+	static_assert(word.count() == 63);
+	constexpr auto not_space = fsv::char_class{"[^[:space:]]"};
+	static_assert(not not_space.contains('\t') and not_space.contains('x'));
+	static_assert(fsv::char_class{"[]a-]"}.count() == 3);
+}
+
+TEST_CASE("char_class parses escapes and rejects malformed expressions") {
+	const auto escaped = fsv::char_class{std::string{"[\\]\\x41\\n-]"}};
+	CHECK(escaped.contains(']'));
+	CHECK(escaped.contains('A'));
+	CHECK(escaped.contains('\n'));
+	CHECK(escaped.contains('-'));
+	CHECK(escaped.count() == 4);
+	CHECK_THROWS_AS(fsv::char_class{"abc"}, std::invalid_argument);
+	CHECK_THROWS_AS(fsv::char_class{"[a-"}, std::invalid_argument);
+	CHECK_THROWS_AS(fsv::char_class{"[z-a]"}, std::invalid_argument);
+	CHECK_THROWS_AS(fsv::char_class{"[[:nope:]]"}, std::invalid_argument);
+}
+
+TEST_CASE("char_class is usable wherever a filter is") {
+	const auto hex = fsv::char_class{"[A-Fa-f /]"};
+	auto sv = fsv::filtered_string_view{"0xDEADBEEF / 0xdeadbeef / 0xDEAD", hex};
+	auto v = fsv::split(sv, fsv::filtered_string_view{" / "});
+	REQUIRE(v.size() == 3);
+	CHECK(v[0] == "DEADBEEF");
+	CHECK(v[1] == "deadbeef");
+	CHECK(v[2] == "DEAD");
+
+	const fsv::filter as_filter = hex;
+	CHECK(as_filter('e'));
+	CHECK(not as_filter('x'));
+}
+
+TEST_CASE("Compose folds adjacent char_class filters into one table") {
+	auto sv = fsv::filtered_string_view{"ab12-CD34", fsv::char_class{"[[:alnum:]]"}};
+	auto composed = fsv::compose(sv, {fsv::char_class{"[^[:digit:]]"}, fsv::char_class{"[^a]"}});
+	const auto* table = composed.predicate().target<fsv::char_class>();
+	REQUIRE(table != nullptr);
+	CHECK(*table == fsv::char_class{"[bA-Zc-z]"});
+	CHECK(static_cast<std::string>(composed) == "bCD");
+}
+
+TEST_CASE("Compose folds every char_class leaf into one table that is tested first") {
+	auto text = std::string{};
+	for (int i = 0; i < 1000; ++i) {
+		text += "abc DEF 123 xyz\n";
+	}
+	auto calls = 0;
+	const auto not_x = [&calls](const char& c) {
+		++calls;
+		return c != 'x';
+	};
+	const auto sv = fsv::filtered_string_view{text, fsv::char_class{"[[:alnum:]]"}};
+	const auto composed = fsv::compose(sv, {not_x, fsv::char_class{"[^[:upper:]]"}, fsv::char_class{"[^3]"}});
+	auto expected = std::string{};
+	for (int i = 0; i < 1000; ++i) {
+		expected += "abc12yz";
+	}
+	CHECK(static_cast<std::string>(composed) == expected);
+	// Only the bytes the folded table accepts reach the lambda.
+	CHECK(calls == 1000 * 8);
+}
+
+TEST_CASE("Scanning spans several 64-byte blocks") {
+	auto text = std::string{};
+	for (int i = 0; i < 50; ++i) {
+		text += "abc,123;";
+	}
+	auto sv = fsv::filtered_string_view{text, fsv::char_class{"[[:digit:]]"}};
+	REQUIRE(sv.size() == 150);
+	CHECK(sv.at(149) == '3');
+	CHECK(sv.count_filtered_chars_before(150) == 249);
+	CHECK_THROWS_AS(sv.at(150), std::domain_error);
+	auto expected = std::string{};
+	for (int i = 0; i < 50; ++i) {
+		expected += "123";
+	}
+	CHECK(static_cast<std::string>(sv) == expected);
+}
+
+TEST_CASE("block_filter is driven once per 64-byte block") {
+	auto calls = 0;
+	auto vowel_mask = [&calls](const char* block, std::size_t n) {
+		++calls;
+		auto mask = std::uint64_t{0};
+		for (std::size_t i = 0; i < n; ++i) {
+			const auto c = block[i];
+			mask |= std::uint64_t{c == 'a' or c == 'e' or c == 'i' or c == 'o' or c == 'u'} << i;
+		}
+		return mask;
+	};
+	auto text = std::string(200, 'x');
+	text[3] = 'a';
+	text[70] = 'e';
+	text[199] = 'o';
+	auto sv = fsv::filtered_string_view{text, fsv::block_filter{vowel_mask}};
+	REQUIRE(sv.size() == 3);
+	CHECK(calls == 4);
+	CHECK(static_cast<std::string>(sv) == "aeo");
+	CHECK(sv.at(1) == 'e');
+	CHECK(sv == "aeo");
+	CHECK(sv.predicate()('u'));
+	CHECK(not sv.predicate()('x'));
+}
+
+TEST_CASE("block_filter ignores mask bits past the end of a short block") {
+	auto everything = fsv::block_filter{[](const char*, std::size_t) { return ~std::uint64_t{0}; }};
+	auto sv = fsv::filtered_string_view{"abc", everything};
+	CHECK(sv.size() == 3);
+	CHECK(fsv::split(sv, fsv::filtered_string_view{"b"}) == std::vector<fsv::filtered_string_view>{"a", "c"});
+}
+
+TEST_CASE("Composed and combined predicates still drive block_filters once per block") {
+	auto calls = 0;
+	const auto digits = fsv::block_filter{[&calls](const char* block, std::size_t n) {
+		++calls;
+		auto mask = std::uint64_t{0};
+		for (std::size_t i = 0; i < n; ++i) {
+			mask |= std::uint64_t{block[i] >= '0' and block[i] <= '9'} << i;
+		}
+		return mask;
+	}};
+	auto text = std::string{};
+	for (int i = 0; i < 4000; ++i) {
+		text += "ab12cd34ef56gh78";
+	}
+	const auto sv = fsv::filtered_string_view{text, digits};
+	CHECK(sv.size() == 32000);
+	CHECK(calls == 1000);
+	calls = 0;
+	auto lambda_calls = 0;
+	const auto not_eight = [&lambda_calls](const char& c) {
+		++lambda_calls;
+		return c != '8';
+	};
+	const auto composed = fsv::compose(sv, {not_eight, fsv::char_class{"[^1]"}});
+	CHECK(composed.size() == 24000);
+	CHECK(calls == 1000);
+	// The lambda only sees the digits the table and block_filter left.
+	CHECK(lambda_calls == 28000);
+	calls = 0;
+	const auto letters = fsv::filtered_string_view{text, [](const char& c) { return c >= 'a' and c <= 'z'; }};
+	const auto either = fsv::unite(sv, letters);
+	CHECK(either.predicate().target<fsv::block_filter>() != nullptr);
+	CHECK(fsv::filtered_string_view{text, either.predicate()}.size() == text.size());
+	CHECK(calls == 1000);
+	CHECK(static_cast<std::string>(fsv::subtract(either, letters)) == static_cast<std::string>(sv));
+}
+
+TEST_CASE("raw_offset and filtered_index map between filtered and raw positions") {
+	auto sv = fsv::filtered_string_view{"example string with spaces", [](const char& c) { return c != ' '; }};
+	CHECK(sv.raw_offset(0) == 0);
+	CHECK(sv.raw_offset(7) == 8);
+	CHECK(sv.raw_offset(13) == 15);
+	CHECK(sv.raw_offset(sv.size()) == 26);
+	CHECK(sv.filtered_index(8) == 7);
+	CHECK(sv.filtered_index(7) == 7);
+	CHECK(sv.filtered_index(26) == sv.size());
+	CHECK_THROWS_AS(sv.raw_offset(sv.size() + 1), std::domain_error);
+	CHECK_THROWS_AS(sv.filtered_index(27), std::domain_error);
+}
+
+TEST_CASE("Position mapping agrees with a linear scan across many superblocks") {
+	auto text = std::string{};
+	for (int i = 0; i < 3000; ++i) {
+		text.push_back(static_cast<char>('a' + (i * 7919) % 26));
+	}
+	auto is_early = [](const char& c) { return c < 'h'; };
+	auto sv = fsv::filtered_string_view{text, is_early};
+	auto accepted = std::size_t{0};
+	for (std::size_t raw = 0; raw < text.size(); ++raw) {
+		REQUIRE(sv.filtered_index(raw) == accepted);
+		if (is_early(text[raw])) {
+			REQUIRE(sv.raw_offset(accepted) == raw);
+			++accepted;
+		}
+	}
+	REQUIRE(sv.size() == accepted);
+}
+
+TEST_CASE("bitmap exposes one acceptance bit per raw byte") {
+	auto text = std::string(130, '.');
+	text[0] = 'x';
+	text[64] = 'x';
+	text[129] = 'x';
+	auto sv = fsv::filtered_string_view{text, [](const char& c) { return c == 'x'; }};
+	const auto words = sv.bitmap();
+	REQUIRE(words.size() == 3);
+	CHECK(words[0] == 1);
+	CHECK(words[1] == 1);
+	CHECK(words[2] == 2);
+}
+
+TEST_CASE("Set operations combine views over the same buffer") {
+	const auto log = std::string{"2024-06-19 ERROR disk 97% full; 2024-06-20 WARN disk 80%"};
+	auto digits = fsv::filtered_string_view{log, fsv::char_class{"[[:digit:]]"}};
+	auto alnum = fsv::filtered_string_view{log, fsv::char_class{"[[:alnum:]]"}};
+	auto upper = fsv::filtered_string_view{log, fsv::char_class{"[[:upper:]]"}};
+
+	CHECK(fsv::intersect(alnum, digits) == digits);
+	CHECK(fsv::subtract(alnum, digits) == "ERRORdiskfullWARNdisk");
+	CHECK(fsv::unite(digits, upper) == "20240619ERROR9720240620WARN80");
+	CHECK(fsv::subtract(alnum, alnum).empty());
+}
+
+TEST_CASE("Set operations do not call the predicates again") {
+	const auto text = std::string{"a1b2c3"};
+	auto calls = 0;
+	auto letters = fsv::filtered_string_view{text, [&calls](const char& c) {
+		                                         ++calls;
+		                                         return std::isalpha(static_cast<unsigned char>(c)) != 0;
+	                                         }};
+	auto everything = fsv::filtered_string_view{text};
+	[[maybe_unused]] const auto warm = letters.bitmap();
+	const auto calls_after_indexing = calls;
+	auto digits = fsv::subtract(everything, letters);
+	CHECK(digits.size() == 3);
+	CHECK(static_cast<std::string>(digits) == "123");
+	CHECK(calls == calls_after_indexing);
+	CHECK(not digits.predicate()('a'));
+	CHECK(digits.predicate()('7'));
+}
+
+TEST_CASE("Set operations reject views over different buffers") {
+	const auto first = std::string{"abc"};
+	const auto second = std::string{"abc"};
+	CHECK_THROWS_AS(fsv::intersect(fsv::filtered_string_view{first}, fsv::filtered_string_view{second}),
+	                std::domain_error);
+	CHECK_THROWS_AS(fsv::unite(fsv::filtered_string_view{first}, fsv::filtered_string_view{first.data(), 2}),
+	                std::domain_error);
+}
+
+TEST_CASE("classify reads the buffer once for every predicate") {
+	const auto line = std::string{"GET /index.html 200 1532\n"};
+	auto calls = 0;
+	auto is_space = [&calls](const char& c) {
+		++calls;
+		return std::isspace(static_cast<unsigned char>(c)) != 0;
+	};
+	auto views = fsv::classify(line.data(),
+	                           line.size(),
+	                           {fsv::char_class{"[[:alpha:]]"}, fsv::char_class{"[[:digit:]]"}, is_space});
+	REQUIRE(views.size() == 3);
+	CHECK(calls == static_cast<int>(line.size()));
+	CHECK(views[0] == "GETindexhtml");
+	CHECK(views[1] == "2001532");
+	CHECK(views[2].size() == 4);
+	CHECK(calls == static_cast<int>(line.size()));
+	CHECK(views[1].raw_offset(3) == 20);
+	CHECK(fsv::unite(views[0], views[1]) == "GETindexhtml2001532");
+}
+
+TEST_CASE("split() pieces share the parent's index") {
+	auto calls = 0;
+	auto not_dash = [&calls](const char& c) {
+		++calls;
+		return c != '-';
+	};
+	const auto csv = std::string{"al-pha,be-ta,,gam-ma-,delta"};
+	auto sv = fsv::filtered_string_view{csv, not_dash};
+	auto pieces = fsv::split(sv, fsv::filtered_string_view{","});
+	const auto calls_after_split = calls;
+	REQUIRE(pieces.size() == 5);
+	CHECK(pieces[0] == "alpha");
+	CHECK(pieces[1] == "beta");
+	CHECK(pieces[2].empty());
+	CHECK(pieces[3] == "gamma");
+	CHECK(pieces[4] == "delta");
+	CHECK(pieces[3].size() == 5);
+	CHECK(pieces[3].at(4) == 'a');
+	CHECK(pieces[3].raw_offset(3) == 4);
+	CHECK(pieces[3].filtered_index(4) == 3);
+	CHECK(calls == calls_after_split);
+}
+
+TEST_CASE("substr() of an indexed view shares the index and realigns its bitmap on demand") {
+	auto text = std::string{};
+	for (int i = 0; i < 40; ++i) {
+		text += "ab-cd ";
+	}
+	auto sv = fsv::filtered_string_view{text, fsv::char_class{"[a-z]"}};
+	[[maybe_unused]] const auto words = sv.bitmap();
+	auto middle = fsv::substr(sv, 3, 70);
+	REQUIRE(middle.size() == 70);
+	CHECK(static_cast<std::string>(middle) == static_cast<std::string>(sv).substr(3, 70));
+	CHECK(middle.at(0) == 'd');
+	const auto middle_words = middle.bitmap();
+	CHECK(middle_words.size() == (middle.raw_offset(70) + 63) / 64);
+	CHECK((middle_words[0] & 1U) == 1U);
+	CHECK(fsv::substr(middle, 1, 2) == "ab");
+	CHECK(fsv::substr(sv, 150, 100).size() == 10);
+}
+
+TEST_CASE("Copies share the index and size that any one of them computes") {
+	auto calls = 0;
+	auto not_space = [&calls](const char& c) {
+		++calls;
+		return c != ' ';
+	};
+	const auto text = std::string{"the quick brown fox jumps over the lazy dog"};
+	auto sv = fsv::filtered_string_view{text, not_space};
+	const auto copy = sv;
+	auto moved = fsv::filtered_string_view{fsv::filtered_string_view{sv}};
+	CHECK(sv.raw_offset(3) == 4);
+	const auto calls_after_index = calls;
+	CHECK(copy.size() == 35);
+	CHECK(copy.at(34) == 'g');
+	CHECK(moved.filtered_index(10) == 8);
+	CHECK(static_cast<std::string>(moved) == "thequickbrownfoxjumpsoverthelazydog");
+	CHECK(calls == calls_after_index);
+
+	auto other = fsv::filtered_string_view{text, not_space};
+	CHECK(other.size() == 35);
+	const auto calls_after_size = calls;
+	CHECK(fsv::filtered_string_view{other}.size() == 35);
+	CHECK(calls == calls_after_size);
+}
+
+TEST_CASE("substr() of a long view indexes it once and then answers from the index") {
+	auto calls = 0;
+	auto not_digit = [&calls](const char& c) {
+		++calls;
+		return c < '0' or c > '9';
+	};
+	auto text = std::string{};
+	while (text.size() < 20000) {
+		text += "abc123defg45 ";
+	}
+	auto sv = fsv::filtered_string_view{text, not_digit};
+	const auto expected = static_cast<std::string>(sv);
+	calls = 0;
+	const auto first = fsv::substr(sv, 5000, 300);
+	CHECK(calls == static_cast<int>(text.size()));
+	CHECK(static_cast<std::string>(first) == expected.substr(5000, 300));
+	const auto tail = fsv::substr(sv, expected.size() - 7);
+	CHECK(static_cast<std::string>(tail) == expected.substr(expected.size() - 7));
+	CHECK(fsv::substr(sv, expected.size()).empty());
+	CHECK(calls == static_cast<int>(text.size()));
+}
+
+TEST_CASE("Iterators are random access and use select() once the view is indexed") {
+	static_assert(std::random_access_iterator<fsv::filtered_string_view::iterator>);
+	static_assert(std::random_access_iterator<fsv::filtered_string_view::const_iterator>);
+	auto calls = 0;
+	auto not_space = [&calls](const char& c) {
+		++calls;
+		return c != ' ';
+	};
+	auto text = std::string{};
+	for (auto c = 'a'; c <= 'z'; ++c) {
+		text += std::string(200, c) + ' ';
+	}
+	const auto sv = fsv::filtered_string_view{text, not_space};
+	CHECK(sv.at(0) == 'a');
+	calls = 0;
+	CHECK(std::ranges::distance(sv) == 26 * 200);
+	const auto it = std::lower_bound(sv.begin(), sv.end(), 'q');
+	CHECK(it - sv.begin() == ('q' - 'a') * 200);
+	CHECK(*(it + 199) == 'q');
+	CHECK(*(it - 1) == 'p');
+	CHECK(sv.cbegin()[1000] == 'f');
+	CHECK(std::next(sv.rbegin(), 200) < sv.rend());
+	CHECK(*std::next(sv.rbegin(), 200) == 'y');
+	CHECK(calls == 0);
+}
+
+TEST_CASE("The index picks its representation from the predicate's selectivity") {
+	auto text = std::string{};
+	for (int i = 0; i < 3000; ++i) {
+		text += i % 20 == 0 ? "lorem ipsum dolor sit amet 9 " : "lorem ipsum dolor sit amet, ";
+	}
+	auto check = [&text](const fsv::filter& pred, fsv::index_kind kind) {
+		auto sv = fsv::filtered_string_view{text, pred};
+		CHECK(sv.index_stats().kind == fsv::index_kind::none);
+		auto expected = std::string{};
+		auto raw = std::vector<std::size_t>{};
+		for (std::size_t i = 0; i < text.size(); ++i) {
+			if (pred(text[i])) {
+				expected.push_back(text[i]);
+				raw.push_back(i);
+			}
+		}
+		REQUIRE(sv.raw_offset(0) == raw.front());
+		const auto stats = sv.index_stats();
+		CHECK(stats.kind == kind);
+		CHECK(stats.bytes > 0);
+		CHECK(static_cast<std::string>(sv) == expected);
+		for (std::size_t k = 0; k < raw.size(); k += 7) {
+			CHECK(sv.raw_offset(k) == raw[k]);
+			CHECK(sv.filtered_index(raw[k]) == k);
+			CHECK(sv.filtered_index(raw[k] + 1) == k + 1);
+		}
+		const auto pos = raw.size() / 3;
+		CHECK(static_cast<std::string>(fsv::substr(sv, pos, pos)) == expected.substr(pos, pos));
+		const auto words = sv.bitmap();
+		CHECK(words.size() == (text.size() + 63) / 64);
+		CHECK(((words[raw.back() / 64] >> (raw.back() % 64)) & 1U) == 1U);
+		return stats.bytes;
+	};
+	const auto sparse = check([](const char& c) { return c == '9'; }, fsv::index_kind::offsets);
+	const auto dense = check([](const char& c) { return c != 'e'; }, fsv::index_kind::bitmap);
+	const auto runs = check([](const char& c) { return c != '9'; }, fsv::index_kind::runs);
+	CHECK(sparse < text.size() / 8);
+	CHECK(runs < dense);
+}
+
+TEST_CASE("Long indexes choose a container per 64 KiB chunk and intersect without decompressing") {
+	auto text = std::string(200000, ' ');
+	for (std::size_t i = 0; i < 65536; ++i) {
+		text[i] = static_cast<char>('a' + i % 7 * 3);
+	}
+	for (std::size_t i = 65536 + 100; i < text.size(); i += 997) {
+		text[i] = 'x';
+	}
+	auto calls = 0;
+	auto not_space = [&calls](const char& c) {
+		++calls;
+		return c != ' ';
+	};
+	auto sv = fsv::filtered_string_view{text, not_space};
+	auto expected = std::string{};
+	auto raw = std::vector<std::size_t>{};
+	for (std::size_t i = 0; i < text.size(); ++i) {
+		if (text[i] != ' ') {
+			expected.push_back(text[i]);
+			raw.push_back(i);
+		}
+	}
+	REQUIRE(sv.size() == expected.size());
+	CHECK(sv.raw_offset(raw.size() - 1) == raw.back());
+	CHECK(sv.index_stats().kind == fsv::index_kind::mixed);
+	CHECK(sv.index_stats().bytes < 65536 / 8 + 4096);
+	for (std::size_t k = 65530; k < raw.size(); ++k) {
+		CHECK(sv.raw_offset(k) == raw[k]);
+		CHECK(sv.filtered_index(raw[k]) == k);
+	}
+	CHECK(static_cast<std::string>(fsv::substr(sv, 65500, 100)) == expected.substr(65500, 100));
+
+	auto letters = fsv::filtered_string_view{text, fsv::char_class{"[a-m]"}};
+	CHECK(letters.raw_offset(0) == 0);
+	calls = 0;
+	const auto both = fsv::intersect(sv, letters);
+	CHECK(calls == 0);
+	const auto in_both = std::count_if(text.begin(), text.end(), [](char c) { return c >= 'a' and c <= 'm'; });
+	CHECK(both.size() == static_cast<std::size_t>(in_both));
+	CHECK(fsv::unite(sv, letters).size() == sv.size());
+	CHECK(fsv::subtract(sv, letters).size() == sv.size() - both.size());
+}
+
+TEST_CASE("A view shared between threads builds its index once and answers consistently") {
+	auto text = std::string{};
+	for (int i = 0; i < 4000; ++i) {
+		text += "fn(x, y) -> z; ";
+	}
+	auto expected = std::string{};
+	std::copy_if(text.begin(), text.end(), std::back_inserter(expected), [](char c) { return c >= 'a' and c <= 'z'; });
+	for (int round = 0; round < 4; ++round) {
+		const auto sv = fsv::filtered_string_view{text, fsv::char_class{"[a-z]"}};
+		const auto copy = sv;
+		auto mismatches = std::atomic<int>{0};
+		auto workers = std::vector<std::thread>{};
+		for (int t = 0; t < 8; ++t) {
+			workers.emplace_back([&, t] {
+				const auto& view = t % 2 == 0 ? sv : copy;
+				for (std::size_t k = static_cast<std::size_t>(t); k < expected.size(); k += 97) {
+					if (view.at(k) != expected[k] or view.size() != expected.size()) {
+						++mismatches;
+					}
+				}
+				if (view.filtered_index(text.size()) != expected.size()) {
+					++mismatches;
+				}
+				// The bitmap is materialised lazily while other threads report the index's footprint.
+				if (t % 2 == 0 and view.bitmap().size() != (text.size() + 63) / 64) {
+					++mismatches;
+				}
+				if (t % 2 == 1 and view.index_stats().bytes == 0) {
+					++mismatches;
+				}
+			});
+		}
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		CHECK(mismatches == 0);
+		CHECK(sv.index_stats().kind != fsv::index_kind::none);
+	}
+}
+
+TEST_CASE("at() on a long view indexes a bounded slice per call and scans the rest") {
+	auto text = std::string(5 * 1024 * 1024, '.');
+	for (std::size_t i = 0; i < text.size(); i += 1000) {
+		text[i] = static_cast<char>('a' + i / 1000 % 26);
+	}
+	auto calls = std::size_t{0};
+	auto not_dot = [&calls](const char& c) {
+		++calls;
+		return c != '.';
+	};
+	const auto sv = fsv::filtered_string_view{text, not_dot};
+	const auto step = std::size_t{16} * 65536;
+	CHECK(sv.at(0) == 'a');
+	CHECK(calls <= step + 64);
+	CHECK(sv.index_stats().kind == fsv::index_kind::offsets);
+	calls = 0;
+	const auto last = (text.size() - 1) / 1000;
+	CHECK(sv.at(last) == static_cast<char>('a' + last % 26));
+	CHECK(calls <= text.size() - step);
+	for (std::size_t k = 0; k < 6; ++k) {
+		CHECK(sv.at(k * 700) == static_cast<char>('a' + k * 700 % 26));
+	}
+	calls = 0;
+	CHECK(sv.at(last - 1) == static_cast<char>('a' + (last - 1) % 26));
+	CHECK(sv.size() == last + 1);
+	CHECK(calls == 0);
+
+	const auto letters = fsv::filtered_string_view{text, fsv::char_class{"[a-z]"}};
+	letters.index_in_background();
+	for (std::size_t k = 0; k <= last; k += 331) {
+		CHECK(letters.at(k) == static_cast<char>('a' + k % 26));
+	}
+	CHECK(letters.filtered_index(text.size()) == last + 1);
+	CHECK(letters.raw_offset(last) == last * 1000);
+}
+
+TEST_CASE("A saved index is attached by a later view over the unchanged file") {
+	const auto dir = std::filesystem::temp_directory_path();
+	const auto source = (dir / "fsv_sidecar_source.log").string();
+	const auto sidecar = (dir / "fsv_sidecar_source.log.fsvidx").string();
+	auto text = std::string{};
+	for (int i = 0; i < 20000; ++i) {
+		text += i % 3 == 0 ? "ERROR 42 disk full\n" : "info ok\n";
+	}
+	std::ofstream(source, std::ios::binary) << text;
+
+	auto digits = fsv::filtered_string_view{text, fsv::char_class{"[0-9]"}};
+	digits.save_index(sidecar, source, "digits");
+
+	auto calls = 0;
+	auto is_digit = [&calls](const char& c) {
+		++calls;
+		return c >= '0' and c <= '9';
+	};
+	const auto reopened = fsv::filtered_string_view{text, is_digit};
+	CHECK_FALSE(reopened.attach_index(sidecar, source, "letters"));
+	REQUIRE(reopened.attach_index(sidecar, source, "digits"));
+	CHECK(reopened.index_stats().kind == digits.index_stats().kind);
+	CHECK(reopened.size() == digits.size());
+	CHECK(reopened.raw_offset(101) == digits.raw_offset(101));
+	CHECK(static_cast<std::string>(fsv::substr(reopened, 10, 6)) == "424242");
+	CHECK(calls == 0);
+
+	std::ofstream(source, std::ios::binary | std::ios::app) << "more\n";
+	const auto stale = fsv::filtered_string_view{text, is_digit};
+	CHECK_FALSE(stale.attach_index(sidecar, source, "digits"));
+	CHECK_FALSE(stale.attach_index(sidecar + ".missing", source, "digits"));
+	std::filesystem::remove(source);
+	std::filesystem::remove(sidecar);
+}
+
+TEST_CASE("A corrupted or truncated sidecar is rejected rather than attached") {
+	const auto dir = std::filesystem::temp_directory_path();
+	const auto source = (dir / "fsv_corrupt_source.log").string();
+	const auto sidecar = (dir / "fsv_corrupt_source.log.fsvidx").string();
+	auto text = std::string{};
+	for (int i = 0; i < 3000; ++i) {
+		text += i % 20 == 0 ? "lorem ipsum dolor sit amet 9 " : "lorem ipsum dolor sit amet, ";
+	}
+	std::ofstream(source, std::ios::binary) << text;
+	const auto read_sidecar = [&sidecar] {
+		auto contents = std::ostringstream();
+		contents << std::ifstream(sidecar, std::ios::binary).rdbuf();
+		return contents.str();
+	};
+	const auto write_sidecar = [&sidecar](const std::string& bytes) {
+		std::ofstream(sidecar, std::ios::binary | std::ios::trunc) << bytes;
+	};
+	const auto attaches = [&](const fsv::filter& pred) {
+		return fsv::filtered_string_view{text, pred}.attach_index(sidecar, source, "id");
+	};
+	const auto predicates = std::vector<std::pair<fsv::filter, fsv::index_kind>>{
+	    {[](const char& c) { return c == '9'; }, fsv::index_kind::offsets},
+	    {[](const char& c) { return c != 'e'; }, fsv::index_kind::bitmap},
+	    {[](const char& c) { return c != '9'; }, fsv::index_kind::runs},
+	};
+	for (const auto& [pred, kind] : predicates) {
+		const auto saved = fsv::filtered_string_view{text, pred};
+		static_cast<void>(saved.raw_offset(0));
+		REQUIRE(saved.index_stats().kind == kind);
+		saved.save_index(sidecar, source, "id");
+		const auto good = read_sidecar();
+		REQUIRE(attaches(pred));
+		// Zeroing the end of the image and cutting the file short leave the headers intact.
+		for (const auto at : {good.size() / 2, good.size() - 64}) {
+			auto zeroed = good;
+			std::fill_n(zeroed.begin() + static_cast<std::ptrdiff_t>(at), 64, '\0');
+			write_sidecar(zeroed);
+			CHECK_FALSE(attaches(pred));
+		}
+		write_sidecar(good.substr(0, good.size() - 8));
+		CHECK_FALSE(attaches(pred));
+		if (kind == fsv::index_kind::bitmap) {
+			for (auto at = good.size() / 4; at < good.size(); at += good.size() / 7) {
+				auto flipped = good;
+				flipped[at] = static_cast<char>(flipped[at] ^ 0x10);
+				write_sidecar(flipped);
+				CHECK_FALSE(attaches(pred));
+			}
+		}
+	}
+	std::filesystem::remove(source);
+	std::filesystem::remove(sidecar);
+}
+
+TEST_CASE("A mapped file hands out views that split without copying the file") {
+	const auto dir = std::filesystem::temp_directory_path();
+	const auto source = (dir / "fsv_mapped_source.log").string();
+	const auto sidecar = (dir / "fsv_mapped_source.log.fsvidx").string();
+	auto text = std::string{};
+	for (int i = 0; i < 30000; ++i) {
+		text += i % 4 == 0 ? "ERROR 7 <disk> full\n" : "info <ok>\n";
+	}
+	std::ofstream(source, std::ios::binary) << text;
+
+	auto file = fsv::mapped_file{source};
+	REQUIRE(file.size() == text.size());
+	const auto no_tags = [](const char& c) {
+		return c != '<' and c != '>';
+	};
+	const auto lines = fsv::split(file.view(no_tags), "\n");
+	REQUIRE(lines.size() == 30001);
+	CHECK(static_cast<std::string>(lines[0]) == "ERROR 7 disk full");
+	CHECK(static_cast<std::string>(lines[1]) == "info ok");
+	CHECK(lines[1].data() >= file.data());
+	CHECK(lines[1].data() < file.data() + file.size());
+	CHECK(lines.back().empty());
+
+	const auto pieces = fsv::split(file.view(no_tags), "ok\ninfo");
+	REQUIRE(pieces.size() == 7500 * 2 + 1);
+	CHECK(static_cast<std::string>(pieces[1]) == " ");
+
+	file.view(fsv::char_class{"[0-9]"}).save_index(sidecar, source, "digits");
+	const auto moved = std::move(file);
+	const auto digits = moved.view(fsv::char_class{"[0-9]"}, sidecar, "digits");
+	CHECK(digits.index_stats().kind != fsv::index_kind::none);
+	CHECK(digits.size() == 7500);
+
+	std::ofstream(source, std::ios::binary | std::ios::trunc);
+	CHECK(fsv::mapped_file{source}.view().empty());
+	std::filesystem::remove(source);
+	std::filesystem::remove(sidecar);
+	CHECK_THROWS_AS(fsv::mapped_file{source}, std::system_error);
+}
+
+TEST_CASE("A stream filter splits like split() whatever the chunk size") {
+	auto text = std::string{};
+	for (int i = 0; i < 500; ++i) {
+		text += i % 7 == 0 ? "k=<" + std::to_string(i) + ">;;" : "v;<;>;x;";
+	}
+	const auto no_tags = [](const char& c) {
+		return c != '<' and c != '>';
+	};
+	const auto delimiter = fsv::filtered_string_view{";;"};
+	auto expected = std::vector<std::string>{};
+	for (const auto& piece : fsv::split(fsv::filtered_string_view{text, no_tags}, delimiter)) {
+		expected.push_back(static_cast<std::string>(piece));
+	}
+	for (const auto chunk_size : {std::size_t{1}, std::size_t{3}, std::size_t{64}, std::size_t{1000}}) {
+		auto pieces = std::vector<std::string>{};
+		auto in = std::istringstream(text);
+		auto stream = fsv::stream_filter{no_tags, chunk_size};
+		CHECK(stream.split(in, delimiter, [&pieces](const fsv::filtered_string_view& piece) {
+			pieces.push_back(static_cast<std::string>(piece));
+		}) == text.size());
+		CHECK(pieces == expected);
+	}
+
+	const auto path = (std::filesystem::temp_directory_path() / "fsv_stream_source.txt").string();
+	std::ofstream(path, std::ios::binary) << text;
+	const auto fd = ::open(path.c_str(), O_RDONLY);
+	REQUIRE(fd >= 0);
+	auto chunks = 0;
+	auto filtered = std::string{};
+	auto stream = fsv::stream_filter{no_tags, 256};
+	CHECK(stream.for_each_chunk(fd, [&](const fsv::filtered_string_view& chunk) {
+		++chunks;
+		filtered += static_cast<std::string>(chunk);
+	}) == text.size());
+	::close(fd);
+	std::filesystem::remove(path);
+	CHECK(chunks == static_cast<int>((text.size() + 255) / 256));
+	CHECK(filtered == static_cast<std::string>(fsv::filtered_string_view{text, no_tags}));
+
+	auto in = std::istringstream("a;");
+	auto short_pieces = std::vector<std::string>{};
+	static_cast<void>(fsv::stream_filter{}.split(in, delimiter, [&](const fsv::filtered_string_view& piece) {
+		short_pieces.push_back(static_cast<std::string>(piece));
+	}));
+	CHECK(short_pieces == std::vector<std::string>{"a;"});
+	CHECK_THROWS_AS(fsv::stream_filter(default_predicate, 0), std::invalid_argument);
+}
+
+TEST_CASE("A segmented view reads a chain of buffers as one filtered string") {
+	const auto is_lower = [](const char& c) {
+		return c >= 'a' and c <= 'z';
+	};
+	const auto a = std::string{"he1l"};
+	const auto b = std::string{"2"};
+	const auto c = std::string{"lo, w"};
+	const auto d = std::string{"orl3d"};
+	auto chain = std::vector<::iovec>{{const_cast<char*>(a.data()), a.size()},
+	                                  {const_cast<char*>(b.data()), b.size()},
+	                                  {nullptr, 0},
+	                                  {const_cast<char*>(c.data()), c.size()},
+	                                  {const_cast<char*>(d.data()), d.size()}};
+	const auto view = fsv::segmented_view{std::span<const ::iovec>(chain), is_lower};
+	CHECK(view.size() == 10);
+	CHECK(view.segments().size() == 4);
+	CHECK(static_cast<std::string>(view) == "helloworld");
+	CHECK(view.at(4) == 'o');
+	CHECK(view[9] == 'd');
+	CHECK_THROWS_AS(view.at(10), std::domain_error);
+	CHECK(std::string(view.rbegin(), view.rend()) == "dlrowolleh");
+	auto out = std::ostringstream();
+	out << view;
+	CHECK(out.str() == "helloworld");
+
+	const auto pieces = fsv::split(view, "lo");
+	REQUIRE(pieces.size() == 2);
+	CHECK(static_cast<std::string>(pieces[0]) == "hel");
+	CHECK(static_cast<std::string>(pieces[1]) == "world");
+	CHECK(pieces[1].segments().size() == 2);
+	CHECK(pieces[0] < pieces[1]);
+	CHECK(pieces[1] == fsv::segmented_view{{"wo", "rld"}});
+
+	const auto storage = std::string{"rld|||hello wo"};
+	const auto ring = fsv::segmented_view::ring(storage.data(), storage.size(), 6, 11);
+	CHECK(static_cast<std::string>(ring) == "hello world");
+	CHECK(fsv::split(ring, " ").size() == 2);
+	CHECK(fsv::split(ring, "lo w")[1] == fsv::segmented_view{{"orld"}});
+	CHECK_THROWS_AS(fsv::segmented_view::ring(storage.data(), storage.size(), 20, 1), std::domain_error);
+	CHECK(fsv::segmented_view::ring(storage.data(), 0, 0, 0).empty());
+}
+
+TEST_CASE("A tail view classifies each appended byte once and carries split state across appends") {
+	auto calls = std::size_t{0};
+	const auto not_digit = [&calls](const char& c) {
+		++calls;
+		return c < '0' or c > '9';
+	};
+	const auto reference = [](const char& c) {
+		return c < '0' or c > '9';
+	};
+	auto log = std::string{};
+	auto tail = fsv::tail_view{not_digit, "\n"};
+	auto pieces = std::vector<std::string>{};
+	for (int i = 0; i < 9000; ++i) {
+		log += "request " + std::to_string(i) + " served\n";
+		if (i % 700 == 0) {
+			// Stop part way through the line, so that pieces and chunks straddle appends.
+			tail.extend(log.data(), log.size() - 5);
+			for (const auto& piece : tail.take_pieces()) {
+				pieces.push_back(static_cast<std::string>(piece));
+			}
+			CHECK(tail.size() == fsv::filtered_string_view{log.data(), log.size() - 5, reference}.size());
+		}
+		if (i == 1400) {
+			CHECK(not tail.view().bitmap().empty());
+		}
+	}
+	log += "tail";
+	tail.extend(log.data(), log.size());
+	for (const auto& piece : tail.take_pieces()) {
+		pieces.push_back(static_cast<std::string>(piece));
+	}
+	pieces.push_back(static_cast<std::string>(tail.rest()));
+	CHECK(calls == log.size());
+	CHECK(tail.length() == log.size());
+
+	const auto whole = fsv::filtered_string_view{log, reference};
+	CHECK(tail.size() == whole.size());
+	CHECK(tail.view() == whole);
+	const auto bitmap = tail.view().bitmap();
+	const auto expected_bitmap = whole.bitmap();
+	CHECK(std::equal(bitmap.begin(), bitmap.end(), expected_bitmap.begin(), expected_bitmap.end()));
+	auto expected = std::vector<std::string>{};
+	for (const auto& piece : fsv::split(whole, "\n")) {
+		expected.push_back(static_cast<std::string>(piece));
+	}
+	CHECK(pieces == expected);
+	CHECK(calls == log.size());
+	CHECK_THROWS_AS(tail.extend(log.data(), 3), std::domain_error);
+
+	// A copy would share the index it grows, so tail views only move, taking their state along.
+	STATIC_REQUIRE_FALSE(std::is_copy_constructible_v<fsv::tail_view>);
+	STATIC_REQUIRE_FALSE(std::is_copy_assignable_v<fsv::tail_view>);
+	STATIC_REQUIRE(std::is_move_constructible_v<fsv::tail_view>);
+	const auto lines = std::string{"ab\ncd\nef\ngh"};
+	auto first = fsv::tail_view{reference, "\n"};
+	first.extend(lines.data(), 6);
+	auto second = std::move(first);
+	second.extend(lines.data(), lines.size());
+	CHECK(second.length() == lines.size());
+	CHECK(second.take_pieces().size() == 3);
+	CHECK(second.rest() == "gh");
+	// The moved-from tail starts over, with the same predicate and delimiter.
+	CHECK(first.length() == 0);
+	CHECK(first.size() == 0);
+	CHECK(first.view().empty());
+	CHECK(first.take_pieces().empty());
+	first.extend(lines.data(), 9);
+	CHECK(first.length() == 9);
+	CHECK(first.take_pieces().size() == 3);
+	CHECK(first.rest().empty());
+	CHECK(second.length() == lines.size());
+	second = std::move(first);
+	CHECK(second.length() == 9);
+	CHECK(first.length() == 0);
+	first.extend(lines.data(), lines.size());
+	CHECK(first.take_pieces().size() == 3);
+	CHECK(first.rest() == "gh");
+}
+
+TEST_CASE("A tail view answers queries on the chunk it is still filling and packs it on request") {
+	const auto is_hash = [](const char& c) {
+		return c == '#';
+	};
+	auto log = std::string{};
+	auto tail = fsv::tail_view{is_hash, "#"};
+	auto check_against_fresh = [&] {
+		const auto whole = fsv::filtered_string_view{log, is_hash};
+		const auto view = tail.view();
+		REQUIRE(view.size() == whole.size());
+		CHECK(view == whole);
+		for (std::size_t i = 0; i < view.size(); i += 97) {
+			CHECK(view.raw_offset(i) == whole.raw_offset(i));
+		}
+		CHECK(view.filtered_index(log.size() / 2) == whole.filtered_index(log.size() / 2));
+		const auto bitmap = view.bitmap();
+		const auto expected = whole.bitmap();
+		CHECK(std::equal(bitmap.begin(), bitmap.end(), expected.begin(), expected.end()));
+	};
+	// Small appends that end part way through words and, once, exactly on a chunk boundary.
+	while (log.size() < 3 * 65536 + 1000) {
+		const auto before = log.size();
+		log += log.size() % 31 == 0 ? "ab#cdefghi" : "abcdefghij";
+		if (before < 2 * 65536 and log.size() > 2 * 65536) {
+			log.resize(2 * 65536);
+		}
+		tail.extend(log.data(), log.size());
+		if (log.size() == 2 * 65536) {
+			check_against_fresh();
+		}
+	}
+	check_against_fresh();
+	CHECK(tail.view().index_stats().kind == fsv::index_kind::mixed);
+	tail.shrink_to_fit();
+	CHECK(tail.view().index_stats().kind == fsv::index_kind::offsets);
+	check_against_fresh();
+	log += "#x#";
+	tail.extend(log.data(), log.size());
+	check_against_fresh();
+}
+
+TEST_CASE("write_to() gathers accepted runs into writev() calls") {
+	const auto path = (std::filesystem::temp_directory_path() / "fsv_write_to.txt").string();
+	auto write_and_read = [&path](const fsv::filtered_string_view& view) {
+		const auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		REQUIRE(fd >= 0);
+		const auto written = fsv::write_to(fd, view);
+		::close(fd);
+		auto contents = std::ostringstream();
+		contents << std::ifstream(path, std::ios::binary).rdbuf();
+		CHECK(written == contents.str().size());
+		return contents.str();
+	};
+	auto text = std::string{};
+	for (int i = 0; i < 5000; ++i) {
+		text += i % 50 == 0 ? std::string(300, 'x') : "a-b-c-d.";
+	}
+	// Long runs are written in place, the alternating bytes through the staging buffer.
+	const auto runs = fsv::filtered_string_view{text, [](const char& c) { return c != '.'; }};
+	CHECK(write_and_read(runs) == static_cast<std::string>(runs));
+	const auto fragmented = fsv::filtered_string_view{text, [](const char& c) { return c != '-'; }};
+	CHECK(write_and_read(fragmented) == static_cast<std::string>(fragmented));
+	CHECK(write_and_read(fsv::filtered_string_view{text}) == text);
+	CHECK(write_and_read(fsv::filtered_string_view{}).empty());
+	std::filesystem::remove(path);
+	CHECK_THROWS_AS(fsv::write_to(-1, fsv::filtered_string_view{"abc"}), std::system_error);
+}
+
+TEST_CASE("parallel_size() and parallel_string() match the serial results on any pool") {
+	auto pool = fsv::thread_pool(4);
+	CHECK(pool.size() == 4);
+	auto hits = std::vector<std::atomic<int>>(1000);
+	pool.parallel_for(hits.size(), [&hits](std::size_t i) { ++hits[i]; });
+	CHECK(std::all_of(hits.begin(), hits.end(), [](const auto& hit) { return hit == 1; }));
+	CHECK_THROWS_AS(pool.parallel_for(100,
+	                                  [](std::size_t i) {
+		                                  if (i == 42) {
+			                                  throw std::domain_error("42");
+		                                  }
+	                                  }),
+	                std::domain_error);
+	auto text = std::string{};
+	while (text.size() < (std::size_t{3} << 20U) + 100) {
+		text += "abc123defg45 ";
+	}
+	auto not_digit = [](const char& c) { return c < '0' or c > '9'; };
+	const auto expected = static_cast<std::string>(fsv::filtered_string_view{text, not_digit});
+	auto serial = fsv::thread_pool(1);
+	for (auto* p : {&pool, &serial}) {
+		const auto plain = fsv::filtered_string_view{text, not_digit};
+		CHECK(fsv::parallel_string(plain, *p) == expected);
+		CHECK(fsv::parallel_size(fsv::filtered_string_view{text, not_digit}, *p) == expected.size());
+		const auto indexed = fsv::filtered_string_view{text, not_digit};
+		static_cast<void>(fsv::substr(indexed, 1));
+		CHECK(fsv::parallel_size(indexed, *p) == expected.size());
+		CHECK(fsv::parallel_string(indexed, *p) == expected);
+	}
+	CHECK(fsv::parallel_string(fsv::filtered_string_view{}).empty());
+	CHECK(fsv::parallel_size(fsv::filtered_string_view{"a1b2"}) == 4);
+}
+
+TEST_CASE("parallel_split() cuts at the same places as split(), across block boundaries") {
+	auto text = std::string{"xx"};
+	for (auto i = std::size_t{0}; text.size() < (std::size_t{3} << 20U); ++i) {
+		text += i % 7 == 0 ? "1x2x3x" : "ab9c-xxx-de,f";
+		text += std::string(i % 5, 'x');
+	}
+	text += "x1x";
+	auto pool = fsv::thread_pool(4);
+	const auto not_digit = [](const char& c) { return c < '0' or c > '9'; };
+	const auto sparse = [](const char& c) { return c == 'x' or c == ','; };
+	for (const auto& pred : std::vector<fsv::filter>{default_predicate, not_digit, sparse}) {
+		for (const auto* tok : {"x", "xx", "xxx", "-d", "c-xxx-de,fa", "no such delimiter"}) {
+			const auto sv = fsv::filtered_string_view{text, pred};
+			const auto expected = fsv::split(sv, tok);
+			const auto pieces = fsv::parallel_split(fsv::filtered_string_view{text, pred}, tok, pool);
+			CHECK(pieces == expected);
+			CHECK(std::equal(pieces.begin(), pieces.end(), expected.begin(), expected.end(), [](auto lhs, auto rhs) {
+				return lhs.data() == rhs.data();
+			}));
+		}
+	}
+	const auto only_newlines = fsv::filtered_string_view{text, [](const char& c) { return c == '\n'; }};
+	CHECK(fsv::parallel_split(only_newlines, "x", pool) == std::vector<fsv::filtered_string_view>{only_newlines});
+	CHECK(fsv::parallel_split(fsv::filtered_string_view{"xax"}, "x", pool)
+	      == std::vector<fsv::filtered_string_view>{"", "a", ""});
+	CHECK(fsv::parallel_split(fsv::filtered_string_view{"xx"}, "x", pool)
+	      == std::vector<fsv::filtered_string_view>{"", "", ""});
+}
+
+TEST_CASE("A task group forks and joins nested work on a work-stealing pool") {
+	const auto fib = [](auto& self, fsv::thread_pool& pool, int n) -> long {
+		if (n < 12) {
+			return n < 2 ? n : self(self, pool, n - 1) + self(self, pool, n - 2);
+		}
+		auto group = fsv::task_group(pool);
+		auto lhs = long{0};
+		group.run([&] { lhs = self(self, pool, n - 1); });
+		const auto rhs = self(self, pool, n - 2);
+		group.wait();
+		return lhs + rhs;
+	};
+	auto pool = fsv::thread_pool(4);
+	auto serial = fsv::thread_pool(1);
+	CHECK(serial.size() == 1);
+	CHECK(fib(fib, pool, 25) == 75025);
+	CHECK(fib(fib, serial, 20) == 6765);
+	// Loops inside loops, each waiting thread running the inner tasks while it waits.
+	auto cells = std::vector<std::atomic<int>>(64 * 64);
+	pool.parallel_for(64, [&](std::size_t row) {
+		pool.parallel_for(64, [&](std::size_t column) { ++cells[row * 64 + column]; });
+	});
+	CHECK(std::all_of(cells.begin(), cells.end(), [](const auto& cell) { return cell == 1; }));
+	auto group = fsv::task_group(pool);
+	for (auto i = 0; i < 100; ++i) {
+		group.run([i] {
+			if (i % 10 == 3) {
+				throw std::domain_error(std::to_string(i));
+			}
+		});
+	}
+	CHECK_THROWS_AS(group.wait(), std::domain_error);
+	CHECK_NOTHROW(group.wait());
+	// With its only worker busy in a task that waits for a task it queues once the joining thread
+	// has found nothing to run, the joining thread has to wake and take that task.
+	auto pair = fsv::thread_pool(2);
+	auto nested = fsv::task_group(pair);
+	auto started = std::atomic<bool>(false);
+	auto ran = std::atomic<bool>(false);
+	auto seen = std::atomic<bool>(false);
+	nested.run([&] {
+		started = true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		nested.run([&] { ran = true; });
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (not ran and std::chrono::steady_clock::now() < deadline) {
+			std::this_thread::yield();
+		}
+		seen = ran.load();
+	});
+	while (not started) {
+		std::this_thread::yield();
+	}
+	nested.wait();
+	CHECK(seen);
+}
+
+TEST_CASE("batch_filter() compacts every input into one arena with one predicate") {
+	auto fields = std::vector<std::string>{};
+	for (auto i = std::size_t{0}; i < 2000; ++i) {
+		fields.push_back("id=" + std::to_string(i) + (i % 3 == 0 ? std::string(70 + i % 90, 'z') : ";x"));
+	}
+	fields.emplace_back();
+	auto inputs = std::vector<std::string_view>(fields.begin(), fields.end());
+	auto calls = 0;
+	auto not_digit = [&calls](const char& c) {
+		++calls;
+		return c < '0' or c > '9';
+	};
+	const auto none = [](const char&) { return false; };
+	for (const auto& pred : std::vector<fsv::filter>{default_predicate, not_digit, fsv::char_class("[a-z]"), none}) {
+		const auto batch = fsv::batch_filter(inputs, pred);
+		REQUIRE(batch.size() == inputs.size());
+		CHECK(batch.offsets().size() == inputs.size() + 1);
+		CHECK(batch.offsets().back() == batch.arena().size());
+		auto expected = std::string{};
+		for (std::size_t i = 0; i < inputs.size(); ++i) {
+			const auto filtered = static_cast<std::string>(fsv::filtered_string_view{fields[i], pred});
+			CHECK(batch[i] == filtered);
+			expected += filtered;
+		}
+		CHECK(batch.arena() == expected);
+	}
+	calls = 0;
+	static_cast<void>(fsv::batch_filter(inputs, not_digit));
+	CHECK(calls == static_cast<int>(fsv::batch_filter(inputs).arena().size()));
+	CHECK(fsv::batch_filter({}).empty());
+	CHECK_THROWS_AS(fsv::batch_filter(inputs).at(inputs.size()), std::domain_error);
+}
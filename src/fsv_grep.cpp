@@ -0,0 +1,260 @@
+#include "./char_class.h"
+#include "./filtered_string_view.h"
+#include "./mapped_file.h"
+#include "./parallel.h"
+#include "./stream_filter.h"
+#include "./thread_pool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <fcntl.h>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+	constexpr auto usage =
+	    "usage: fsv_grep [-k CLASS] [-d DELIMITER] [-e PATTERN] [-j THREADS] [FILE...]\n"
+	    "Filters each FILE (or standard input, or '-') down to the bytes in the bracket expression\n"
+	    "CLASS, such as '[^[:cntrl:]]'. With -d or -e, the filtered text is split on DELIMITER\n"
+	    "(default \\n) and each piece containing the fixed string PATTERN is printed on its own line.\n"
+	    "Large files are filtered on THREADS threads (default: one per core), and searched on them when\n"
+	    "DELIMITER is a single character. Exits with 0 if a piece was printed, 1 if none was and 2 on\n"
+	    "error.\n";
+	// Each thread takes at least this much of a mapped file per round.
+	constexpr auto range_size = std::size_t{16} << 20U;
+	constexpr auto output_batch = std::size_t{1} << 16U;
+
+	struct options {
+		fsv::filter keep = default_predicate;
+		std::string delimiter = "\n";
+		std::optional<std::string> pattern;
+		bool split = false;
+		// 0 runs on the shared pool, with one thread per core.
+		unsigned threads = 0;
+		std::vector<std::string> files;
+	};
+
+	auto unescape(std::string_view text) -> std::string {
+		auto result = std::string();
+		for (std::size_t i = 0; i < text.size(); ++i) {
+			if (text[i] != '\\' or i + 1 == text.size()) {
+				result += text[i];
+				continue;
+			}
+			switch (text[++i]) {
+			case 'n': result += '\n'; break;
+			case 't': result += '\t'; break;
+			case 'r': result += '\r'; break;
+			case '0': result += '\0'; break;
+			default: result += text[i]; break;
+			}
+		}
+		return result;
+	}
+
+	auto parse(int argc, char** argv) -> options {
+		auto opts = options();
+		auto args = std::vector<std::string_view>(argv + 1, argv + argc);
+		for (std::size_t i = 0; i < args.size(); ++i) {
+			const auto arg = args[i];
+			if (arg.size() < 2 or arg[0] != '-' or arg == "--") {
+				const auto first = arg == "--" ? i + 1 : i;
+				opts.files.insert(opts.files.end(), args.begin() + static_cast<std::ptrdiff_t>(first), args.end());
+				break;
+			}
+			if (arg == "-h") {
+				std::cout << usage;
+				std::exit(0);
+			}
+			if (i + 1 == args.size()) {
+				throw std::invalid_argument("option " + std::string(arg) + " needs a value");
+			}
+			const auto value = std::string(args[++i]);
+			if (arg == "-k") {
+				opts.keep = fsv::char_class(value);
+			}
+			else if (arg == "-d") {
+				opts.delimiter = unescape(value);
+				opts.split = true;
+			}
+			else if (arg == "-e") {
+				opts.pattern = value;
+				opts.split = true;
+			}
+			else if (arg == "-j") {
+				opts.threads = std::max(1U, static_cast<unsigned>(std::stoul(value)));
+			}
+			else {
+				throw std::invalid_argument("unknown option " + std::string(arg));
+			}
+		}
+		if (opts.files.empty()) {
+			opts.files.emplace_back("-");
+		}
+		return opts;
+	}
+
+	auto flush(std::string& out) -> void {
+		static_cast<void>(fsv::write_to(STDOUT_FILENO, fsv::filtered_string_view(out)));
+		out.clear();
+	}
+	auto print_if_match(std::string_view text, const options& opts, std::string& out) -> bool {
+		if (opts.pattern and text.find(*opts.pattern) == std::string_view::npos) {
+			return false;
+		}
+		out += text;
+		out += '\n';
+		return true;
+	}
+	// Prints the matching pieces of view. An empty last piece is only printed when it is the only
+	// piece of the input; a view that does not reach the end of the input ends just after a
+	// delimiter, so its empty last piece is never printed.
+	auto grep_view(const fsv::filtered_string_view& view, const options& opts, bool starts_input, std::string& out)
+	    -> std::size_t {
+		auto pieces = fsv::split(view, fsv::filtered_string_view(opts.delimiter));
+		if (pieces.back().empty() and (pieces.size() > 1 or not starts_input)) {
+			pieces.pop_back();
+		}
+		return static_cast<std::size_t>(std::count_if(pieces.begin(), pieces.end(), [&](const auto& piece) {
+			return print_if_match(static_cast<std::string>(piece), opts, out);
+		}));
+	}
+	// The raw offset just past the first accepted delimiter at or after from.
+	auto cut(const fsv::mapped_file& file, const options& opts, std::size_t from) -> std::size_t {
+		for (auto i = std::min(from, file.size()); i < file.size(); ++i) {
+			if (file.data()[i] == opts.delimiter[0] and opts.keep(file.data()[i])) {
+				return i + 1;
+			}
+		}
+		return file.size();
+	}
+	// Splitting on one character can start afresh after any delimiter, so the file is cut into one
+	// range per thread just after a delimiter, and the ranges' output is printed in order.
+	auto grep_file(const fsv::mapped_file& file, const options& opts, fsv::thread_pool& pool) -> std::size_t {
+		auto out = std::string();
+		if (pool.size() == 1 or opts.delimiter.size() != 1 or file.size() < 2 * range_size) {
+			const auto matches = grep_view(file.view(opts.keep), opts, true, out);
+			flush(out);
+			return matches;
+		}
+		auto matches = std::size_t{0};
+		for (auto from = std::size_t{0}; from < file.size();) {
+			auto bounds = std::vector<std::size_t>{from};
+			for (std::size_t t = 0; t < pool.size() and bounds.back() < file.size(); ++t) {
+				bounds.push_back(cut(file, opts, bounds.back() + range_size));
+			}
+			auto outputs = std::vector<std::string>(bounds.size() - 1);
+			auto counts = std::vector<std::size_t>(bounds.size() - 1);
+			pool.parallel_for(outputs.size(), [&](std::size_t i) {
+				const auto length = bounds[i + 1] - bounds[i];
+				const auto range = fsv::filtered_string_view(file.data() + bounds[i], length, opts.keep);
+				counts[i] = grep_view(range, opts, bounds[i] == 0, outputs[i]);
+			});
+			for (std::size_t i = 0; i < outputs.size(); ++i) {
+				flush(outputs[i]);
+				matches += counts[i];
+			}
+			from = bounds.back();
+		}
+		return matches;
+	}
+	// Without splitting there is nothing to stitch, so each round filters as many ranges as there
+	// are threads into one string and writes it before the next, bounding the memory held.
+	auto filter_file(const fsv::mapped_file& file, const options& opts, fsv::thread_pool& pool) -> void {
+		if (pool.size() == 1 or file.size() < 2 * range_size) {
+			static_cast<void>(fsv::write_to(STDOUT_FILENO, file.view(opts.keep)));
+			return;
+		}
+		const auto round = range_size * pool.size();
+		for (auto from = std::size_t{0}; from < file.size(); from += round) {
+			const auto length = std::min(round, file.size() - from);
+			auto out = fsv::parallel_string(fsv::filtered_string_view(file.data() + from, length, opts.keep), pool);
+			flush(out);
+		}
+	}
+	// Each piece is held back until the next arrives, to know whether it is the empty last piece.
+	auto grep_stream(int fd, const options& opts) -> std::size_t {
+		auto stream = fsv::stream_filter(opts.keep);
+		auto out = std::string();
+		auto matches = std::size_t{0};
+		auto pieces = std::size_t{0};
+		auto held = std::string();
+		static_cast<void>(stream.split(fd, fsv::filtered_string_view(opts.delimiter), [&](const auto& piece) {
+			if (pieces++ > 0 and print_if_match(held, opts, out)) {
+				++matches;
+			}
+			held = static_cast<std::string>(piece);
+			if (out.size() >= output_batch) {
+				flush(out);
+			}
+		}));
+		if ((pieces == 1 or not held.empty()) and print_if_match(held, opts, out)) {
+			++matches;
+		}
+		flush(out);
+		return matches;
+	}
+	auto filter_stream(int fd, const options& opts) -> void {
+		auto stream = fsv::stream_filter(opts.keep);
+		static_cast<void>(stream.for_each_chunk(fd, [](const fsv::filtered_string_view& chunk) {
+			static_cast<void>(fsv::write_to(STDOUT_FILENO, chunk));
+		}));
+	}
+
+	auto run(const std::string& path, const options& opts, fsv::thread_pool& pool) -> std::size_t {
+		struct stat info = {};
+		if (path != "-" and ::stat(path.c_str(), &info) == 0 and S_ISREG(info.st_mode)) {
+			const auto file = fsv::mapped_file(path);
+			if (not opts.split) {
+				filter_file(file, opts, pool);
+				return 0;
+			}
+			return grep_file(file, opts, pool);
+		}
+		const auto fd = path == "-" ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			throw std::runtime_error("cannot open " + path);
+		}
+		auto matches = std::size_t{0};
+		if (opts.split) {
+			matches = grep_stream(fd, opts);
+		}
+		else {
+			filter_stream(fd, opts);
+		}
+		if (fd != STDIN_FILENO) {
+			::close(fd);
+		}
+		return matches;
+	}
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+	try {
+		const auto opts = parse(argc, argv);
+		auto own_pool = std::optional<fsv::thread_pool>();
+		if (opts.threads != 0) {
+			own_pool.emplace(opts.threads);
+		}
+		auto& pool = own_pool ? *own_pool : fsv::thread_pool::shared();
+		auto matches = std::size_t{0};
+		for (const auto& path : opts.files) {
+			matches += run(path, opts, pool);
+		}
+		return not opts.split or matches > 0 ? 0 : 1;
+	} catch (const std::invalid_argument& e) {
+		std::cerr << "fsv_grep: " << e.what() << '\n' << usage;
+		return 2;
+	} catch (const std::exception& e) {
+		std::cerr << "fsv_grep: " << e.what() << '\n';
+		return 2;
+	}
+}
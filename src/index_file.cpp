@@ -0,0 +1,125 @@
+#include "./index_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fsv::detail {
+	namespace {
+		constexpr auto sidecar_magic = std::uint64_t{0x5845444e49565346}; // "FSVINDEX"
+		constexpr auto sidecar_version = std::uint32_t{1};
+
+		struct sidecar_header {
+			std::uint64_t magic;
+			std::uint32_t version;
+			std::uint32_t id_length;
+			std::uint64_t source_size;
+			std::int64_t source_mtime;
+			std::uint64_t image_offset;
+			std::uint64_t image_size;
+		};
+
+		struct source_stamp {
+			std::uint64_t size;
+			std::int64_t mtime;
+		};
+
+		auto stamp(const std::string& path) -> std::optional<source_stamp> {
+			struct stat info = {};
+			if (::stat(path.c_str(), &info) != 0) {
+				return std::nullopt;
+			}
+			return source_stamp{static_cast<std::uint64_t>(info.st_size),
+			                    static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1'000'000'000
+			                        + static_cast<std::int64_t>(info.st_mtim.tv_nsec)};
+		}
+
+		auto image_offset(std::size_t id_length) -> std::size_t {
+			return (sizeof(sidecar_header) + id_length + 7) / 8 * 8;
+		}
+	} // namespace
+
+	// The sidecar is written beside its final name and renamed into place, so a reader never maps
+	// a half-written file.
+	auto save_sidecar(const std::string& sidecar_path,
+	                  const std::string& source_path,
+	                  std::string_view predicate_id,
+	                  const acceptance_index& index) -> void {
+		const auto source = stamp(source_path);
+		if (not source) {
+			throw std::runtime_error("fsv::save_index: cannot stat " + source_path);
+		}
+		auto image = std::ostringstream();
+		index.save(image);
+		const auto bytes = std::move(image).str();
+		const auto offset = image_offset(predicate_id.size());
+		const auto header = sidecar_header{sidecar_magic,
+		                                   sidecar_version,
+		                                   static_cast<std::uint32_t>(predicate_id.size()),
+		                                   source->size,
+		                                   source->mtime,
+		                                   offset,
+		                                   bytes.size()};
+		const auto temporary = sidecar_path + ".tmp";
+		{
+			auto out = std::ofstream(temporary, std::ios::binary | std::ios::trunc);
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(predicate_id.data(), static_cast<std::streamsize>(predicate_id.size()));
+			out.write(std::string(offset - sizeof(header) - predicate_id.size(), '\0').data(),
+			          static_cast<std::streamsize>(offset - sizeof(header) - predicate_id.size()));
+			out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+			if (not out.flush()) {
+				throw std::runtime_error("fsv::save_index: cannot write " + temporary);
+			}
+		}
+		if (std::rename(temporary.c_str(), sidecar_path.c_str()) != 0) {
+			std::remove(temporary.c_str());
+			throw std::runtime_error("fsv::save_index: cannot write " + sidecar_path);
+		}
+	}
+
+	auto load_sidecar(const std::string& sidecar_path, const std::string& source_path, std::string_view predicate_id)
+	    -> std::unique_ptr<const acceptance_index> {
+		const auto source = stamp(source_path);
+		const auto fd = ::open(sidecar_path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (not source or fd < 0) {
+			if (fd >= 0) {
+				::close(fd);
+			}
+			return nullptr;
+		}
+		struct stat info = {};
+		const auto size = ::fstat(fd, &info) == 0 ? static_cast<std::size_t>(info.st_size) : 0;
+		auto* address = MAP_FAILED;
+		if (size >= sizeof(sidecar_header)) {
+			address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		::close(fd);
+		if (address == MAP_FAILED) {
+			return nullptr;
+		}
+		auto mapping = std::shared_ptr<const void>(address, [size](const void* p) {
+			::munmap(const_cast<void*>(p), size);
+		});
+		const auto* bytes = static_cast<const std::byte*>(address);
+		auto header = sidecar_header();
+		std::memcpy(&header, bytes, sizeof(header));
+		if (header.magic != sidecar_magic or header.version != sidecar_version
+		    or header.id_length != predicate_id.size() or header.source_size != source->size
+		    or header.source_mtime != source->mtime or header.image_offset != image_offset(header.id_length)
+		    or header.image_offset > size or header.image_size > size - header.image_offset
+		    or std::memcmp(bytes + sizeof(header), predicate_id.data(), predicate_id.size()) != 0)
+		{
+			return nullptr;
+		}
+		const auto image = std::span<const std::byte>(bytes + header.image_offset, header.image_size);
+		return acceptance_index::load(image, std::move(mapping));
+	}
+} // namespace fsv::detail
@@ -0,0 +1,25 @@
+#ifndef COMP6771_ASS2_INDEX_FILE_H
+#define COMP6771_ASS2_INDEX_FILE_H
+
+#include "./acceptance_index.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace fsv::detail {
+	// Sidecar files hold a saved acceptance index together with the size and modification time of
+	// the file it was built from and a caller-chosen name for the predicate. A sidecar is only
+	// loaded back when all three still match and its contents are consistent. It is mapped rather
+	// than copied, so loading it costs one pass over the saved index, not over the source.
+	auto save_sidecar(const std::string& sidecar_path,
+	                  const std::string& source_path,
+	                  std::string_view predicate_id,
+	                  const acceptance_index& index) -> void;
+	// Returns nothing if the sidecar is missing, malformed, from another version or out of date.
+	[[nodiscard]] auto load_sidecar(const std::string& sidecar_path,
+	                                const std::string& source_path,
+	                                std::string_view predicate_id) -> std::unique_ptr<const acceptance_index>;
+} // namespace fsv::detail
+
+#endif // COMP6771_ASS2_INDEX_FILE_H
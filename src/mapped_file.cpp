@@ -0,0 +1,103 @@
+#include "./mapped_file.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace fsv {
+	namespace {
+		auto fail(const std::string& what, const std::string& path) -> void {
+			throw std::system_error(errno, std::generic_category(), "fsv::mapped_file: cannot " + what + " " + path);
+		}
+	} // namespace
+
+	// An empty file is not mapped at all (mmap rejects a zero length); its views point at "".
+	// madvise failures are ignored: the hints only change how the file is paged in.
+	mapped_file::mapped_file(const std::string& path, access pattern, bool huge_pages)
+	: file_path(path)
+	, address("")
+	, length(0) {
+		const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			fail("open", path);
+		}
+		struct stat info = {};
+		if (::fstat(fd, &info) != 0) {
+			const auto error = errno;
+			::close(fd);
+			errno = error;
+			fail("stat", path);
+		}
+		const auto size = static_cast<std::size_t>(info.st_size);
+		if (size == 0) {
+			::close(fd);
+			return;
+		}
+		auto* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		const auto error = errno;
+		::close(fd);
+		if (mapping == MAP_FAILED) {
+			errno = error;
+			fail("map", path);
+		}
+		if (pattern == access::sequential) {
+			static_cast<void>(::madvise(mapping, size, MADV_SEQUENTIAL));
+			static_cast<void>(::madvise(mapping, size, MADV_WILLNEED));
+		}
+		else {
+			static_cast<void>(::madvise(mapping, size, MADV_RANDOM));
+		}
+#ifdef MADV_HUGEPAGE
+		if (huge_pages) {
+			static_cast<void>(::madvise(mapping, size, MADV_HUGEPAGE));
+		}
+#else
+		static_cast<void>(huge_pages);
+#endif
+		address = static_cast<const char*>(mapping);
+		length = size;
+	}
+	mapped_file::mapped_file(mapped_file&& other) noexcept
+	: file_path(std::move(other.file_path))
+	, address(std::exchange(other.address, ""))
+	, length(std::exchange(other.length, 0)) {}
+	auto mapped_file::operator=(mapped_file&& other) noexcept -> mapped_file& {
+		if (this != &other) {
+			unmap();
+			file_path = std::move(other.file_path);
+			address = std::exchange(other.address, "");
+			length = std::exchange(other.length, 0);
+		}
+		return *this;
+	}
+	mapped_file::~mapped_file() {
+		unmap();
+	}
+	auto mapped_file::unmap() noexcept -> void {
+		if (length != 0) {
+			::munmap(const_cast<char*>(address), length);
+		}
+	}
+	auto mapped_file::data() const noexcept -> const char* {
+		return address;
+	}
+	auto mapped_file::size() const noexcept -> std::size_t {
+		return length;
+	}
+	auto mapped_file::path() const noexcept -> const std::string& {
+		return file_path;
+	}
+	auto mapped_file::view(filter predicate) const -> filtered_string_view {
+		return filtered_string_view(address, length, std::move(predicate));
+	}
+	auto mapped_file::view(filter predicate, const std::string& sidecar_path, std::string_view predicate_id) const
+	    -> filtered_string_view {
+		auto result = view(std::move(predicate));
+		static_cast<void>(result.attach_index(sidecar_path, file_path, predicate_id));
+		return result;
+	}
+} // namespace fsv
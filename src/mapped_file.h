@@ -0,0 +1,42 @@
+#ifndef COMP6771_ASS2_MAPPED_FILE_H
+#define COMP6771_ASS2_MAPPED_FILE_H
+
+#include "./filtered_string_view.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace fsv {
+	// A read-only mapping of a whole file that hands out filtered views over its contents, so inputs
+	// larger than memory are paged in by the kernel as they are read instead of being copied. The
+	// views borrow the mapping and must not outlive the mapped_file they came from.
+	class mapped_file {
+	 public:
+		// sequential asks for aggressive read-ahead and starts paging the file in at once; random turns
+		// read-ahead off. Huge pages are only a request: kernels without them for files ignore it.
+		enum class access { sequential, random };
+
+		explicit mapped_file(const std::string& path, access pattern = access::sequential, bool huge_pages = false);
+		mapped_file(const mapped_file&) = delete;
+		mapped_file(mapped_file&& other) noexcept;
+		auto operator=(const mapped_file&) -> mapped_file& = delete;
+		auto operator=(mapped_file&& other) noexcept -> mapped_file&;
+		~mapped_file();
+		[[nodiscard]] auto data() const noexcept -> const char*;
+		[[nodiscard]] auto size() const noexcept -> std::size_t;
+		[[nodiscard]] auto path() const noexcept -> const std::string&;
+		[[nodiscard]] auto view(filter predicate = default_predicate) const -> filtered_string_view;
+		// As above, attaching the index saved for this file in sidecar_path if it is still current.
+		[[nodiscard]] auto view(filter predicate, const std::string& sidecar_path, std::string_view predicate_id) const
+		    -> filtered_string_view;
+
+	 private:
+		auto unmap() noexcept -> void;
+		std::string file_path;
+		const char* address;
+		std::size_t length;
+	};
+} // namespace fsv
+
+#endif // COMP6771_ASS2_MAPPED_FILE_H
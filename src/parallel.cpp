@@ -0,0 +1,192 @@
+#include "./parallel.h"
+#include "./acceptance_index.h"
+#include "./delimiter_search.h"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+#include <vector>
+
+namespace fsv {
+	namespace {
+		constexpr auto parallel_block = std::size_t{1} << 20U;
+
+		auto block_count(std::size_t length) noexcept -> std::size_t {
+			return (length + parallel_block - 1) / parallel_block;
+		}
+		// Calls visit(offset, mask) for each 64-byte block of the b-th parallel block of the buffer.
+		template<typename Visitor>
+		auto for_each_block_of(const char* ptr,
+		                       std::size_t length,
+		                       const filter& pred,
+		                       detail::index_window window,
+		                       std::size_t b,
+		                       Visitor visit) -> void {
+			const auto scan = detail::scanner(pred);
+			const auto end = std::min(length, (b + 1) * parallel_block);
+			for (auto offset = b * parallel_block; offset < end; offset += detail::block_size) {
+				const auto n = std::min(detail::block_size, end - offset);
+				visit(offset, window ? window.word_at(offset) : scan.mask(ptr + offset, n));
+			}
+		}
+		auto count_block(const char* ptr,
+		                 std::size_t length,
+		                 const filter& pred,
+		                 detail::index_window window,
+		                 std::size_t b) -> std::size_t {
+			auto count = std::size_t{0};
+			for_each_block_of(ptr, length, pred, window, b, [&count](std::size_t, std::uint64_t bits) {
+				count += detail::popcount(bits);
+			});
+			return count;
+		}
+
+		struct accepted_char {
+			char c;
+			std::size_t raw_end;
+		};
+		// A delimiter match found by parallel_split(): the number of accepted characters up to its
+		// end, and the raw offsets delimiter_search gives for it.
+		struct delimiter_match {
+			std::size_t end_index;
+			std::size_t piece_end;
+			std::size_t match_end;
+		};
+		// The last n accepted characters of the b-th parallel block, or all of them if it has fewer.
+		auto last_accepted(const char* ptr,
+		                   std::size_t length,
+		                   const filter& pred,
+		                   detail::index_window window,
+		                   std::size_t b,
+		                   std::size_t n) -> std::vector<accepted_char> {
+			const auto scan = detail::scanner(pred);
+			const auto begin = b * parallel_block;
+			auto result = std::vector<accepted_char>();
+			for (auto end = std::min(length, (b + 1) * parallel_block); result.size() < n and end > begin;) {
+				const auto offset = begin + (end - 1 - begin) / detail::block_size * detail::block_size;
+				auto bits = window ? window.word_at(offset) : scan.mask(ptr + offset, end - offset);
+				for (; bits != 0 and result.size() < n;) {
+					const auto top = static_cast<std::size_t>(63 - std::countl_zero(bits));
+					bits ^= std::uint64_t{1} << top;
+					result.push_back({ptr[offset + top], offset + top + 1});
+				}
+				end = offset;
+			}
+			std::reverse(result.begin(), result.end());
+			return result;
+		}
+	} // namespace
+
+	auto parallel_size(const filtered_string_view& fsv, thread_pool& pool) -> std::size_t {
+		if (not fsv.str_state) {
+			return 0;
+		}
+		if (const auto cached = fsv.str_state->cached_size()) {
+			return *cached;
+		}
+		if (const auto window = fsv.index_window()) {
+			return window.count();
+		}
+		auto counts = std::vector<std::size_t>(block_count(fsv.str_length));
+		pool.parallel_for(counts.size(), [&](std::size_t b) {
+			counts[b] = count_block(fsv.ptr, fsv.str_length, fsv.predicate(), {}, b);
+		});
+		const auto total = std::accumulate(counts.begin(), counts.end(), std::size_t{0});
+		fsv.str_state->publish_size(total);
+		return total;
+	}
+	auto parallel_string(const filtered_string_view& fsv, thread_pool& pool) -> std::string {
+		if (not fsv.str_state) {
+			return std::string();
+		}
+		const auto window = fsv.index_window();
+		const auto blocks = block_count(fsv.str_length);
+		auto starts = std::vector<std::size_t>(blocks + 1);
+		if (window) {
+			for (std::size_t b = 0; b <= blocks; ++b) {
+				starts[b] = window.rank(std::min(b * parallel_block, fsv.str_length));
+			}
+		}
+		else {
+			pool.parallel_for(blocks, [&](std::size_t b) {
+				starts[b + 1] = count_block(fsv.ptr, fsv.str_length, fsv.predicate(), {}, b);
+			});
+			std::inclusive_scan(starts.begin(), starts.end(), starts.begin());
+			fsv.str_state->publish_size(starts.back());
+		}
+		auto result = std::string(starts.back(), '\0');
+		pool.parallel_for(blocks, [&](std::size_t b) {
+			auto* out = result.data() + starts[b];
+			const auto copy = [&](std::size_t offset, std::uint64_t bits) {
+				for (; bits != 0; bits &= bits - 1) {
+					*out++ = fsv.ptr[offset + static_cast<std::size_t>(std::countr_zero(bits))];
+				}
+			};
+			for_each_block_of(fsv.ptr, fsv.str_length, fsv.predicate(), window, b, copy);
+		});
+		return result;
+	}
+	auto parallel_split(const filtered_string_view& fsv, const filtered_string_view& tok, thread_pool& pool)
+	    -> std::vector<filtered_string_view> {
+		const auto delim = static_cast<std::string>(tok);
+		const auto blocks = block_count(fsv.str_length);
+		if (delim.empty() or not fsv.str_state or blocks <= 1) {
+			return split(fsv, tok);
+		}
+		const auto window = fsv.index_window();
+		auto starts = std::vector<std::size_t>(blocks + 1);
+		auto tails = std::vector<std::vector<accepted_char>>(blocks);
+		pool.parallel_for(blocks, [&](std::size_t b) {
+			starts[b + 1] = count_block(fsv.ptr, fsv.str_length, fsv.predicate(), window, b);
+			tails[b] = last_accepted(fsv.ptr, fsv.str_length, fsv.predicate(), window, b, delim.size());
+		});
+		std::inclusive_scan(starts.begin(), starts.end(), starts.begin());
+		fsv.str_state->publish_size(starts.back());
+		if (starts.back() < delim.size()) {
+			return {fsv};
+		}
+		// Every occurrence is collected, overlapping or not, since which of two overlapping ones
+		// split() cuts at depends on the matches before them.
+		auto matches = std::vector<std::vector<delimiter_match>>(blocks);
+		pool.parallel_for(blocks, [&](std::size_t b) {
+			auto search = detail::delimiter_search(delim, true);
+			auto context = std::vector<accepted_char>();
+			for (auto before = b; before-- > 0 and context.size() < delim.size();) {
+				const auto& tail = tails[before];
+				const auto take = std::min(tail.size(), delim.size() - context.size());
+				context.insert(context.begin(), tail.end() - static_cast<std::ptrdiff_t>(take), tail.end());
+			}
+			for (const auto& [c, raw_end] : context) {
+				static_cast<void>(search.feed(c, raw_end));
+			}
+			auto index = starts[b];
+			const auto find = [&](std::size_t offset, std::uint64_t bits) {
+				for (; bits != 0; bits &= bits - 1) {
+					const auto at = offset + static_cast<std::size_t>(std::countr_zero(bits));
+					++index;
+					if (search.feed(fsv.ptr[at], at + 1)) {
+						matches[b].push_back({index, search.piece_end(), search.match_end()});
+					}
+				}
+			};
+			for_each_block_of(fsv.ptr, fsv.str_length, fsv.predicate(), window, b, find);
+		});
+		auto result = std::vector<filtered_string_view>();
+		auto raw_from = std::size_t{0};
+		auto cut_at = std::size_t{0};
+		for (const auto& found : matches) {
+			for (const auto& match : found) {
+				if (match.end_index - delim.size() >= cut_at) {
+					result.push_back(fsv.slice(raw_from, match.piece_end));
+					raw_from = match.match_end;
+					cut_at = match.end_index;
+				}
+			}
+		}
+		const auto last = std::find_if(tails.rbegin(), tails.rend(), [](const auto& tail) {
+			return not tail.empty();
+		});
+		result.push_back(fsv.slice(raw_from, last->back().raw_end));
+		return result;
+	}
+} // namespace fsv
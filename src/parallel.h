@@ -0,0 +1,28 @@
+#ifndef COMP6771_ASS2_PARALLEL_H
+#define COMP6771_ASS2_PARALLEL_H
+
+#include "./filtered_string_view.h"
+#include "./thread_pool.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace fsv {
+	// Parallel counterparts of size() and operator std::string(), with identical results. The view
+	// is cut into 1 MiB blocks that are counted on the pool; the conversion then takes an exclusive
+	// prefix sum of the counts and copies each block straight to its place in the result. The
+	// predicate is called from several threads at once.
+	[[nodiscard]] auto parallel_size(const filtered_string_view& fsv, thread_pool& pool = thread_pool::shared())
+	    -> std::size_t;
+	[[nodiscard]] auto parallel_string(const filtered_string_view& fsv, thread_pool& pool = thread_pool::shared())
+	    -> std::string;
+	// Returns the same pieces as split(fsv, tok). Each block is searched for the delimiter on the
+	// pool, starting from the accepted characters that end the blocks before it, so matches that
+	// straddle a block boundary are found; the matches are then chosen in order, as split() would.
+	[[nodiscard]] auto parallel_split(const filtered_string_view& fsv,
+	                                  const filtered_string_view& tok,
+	                                  thread_pool& pool = thread_pool::shared()) -> std::vector<filtered_string_view>;
+} // namespace fsv
+
+#endif // COMP6771_ASS2_PARALLEL_H
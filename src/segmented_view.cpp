@@ -0,0 +1,260 @@
+#include "./segmented_view.h"
+#include "./acceptance_index.h"
+#include "./delimiter_search.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+namespace fsv {
+	namespace {
+		auto to_parts(std::span<const ::iovec> segments) -> std::vector<std::string_view> {
+			auto parts = std::vector<std::string_view>();
+			parts.reserve(segments.size());
+			for (const auto& segment : segments) {
+				parts.emplace_back(static_cast<const char*>(segment.iov_base), segment.iov_len);
+			}
+			return parts;
+		}
+	} // namespace
+
+	segmented_view::const_iter::const_iter() noexcept
+	: view(nullptr)
+	, segment(0)
+	, offset(0) {}
+	segmented_view::const_iter::const_iter(const segmented_view* view, std::size_t segment, std::size_t offset) noexcept
+	: view(view)
+	, segment(segment)
+	, offset(offset) {}
+	auto segmented_view::const_iter::operator*() const -> reference {
+		return view->parts[segment].data()[offset];
+	}
+	auto segmented_view::const_iter::operator->() const -> pointer {
+		return view->parts[segment].data() + offset;
+	}
+	auto segmented_view::const_iter::operator++() -> const_iter& {
+		++offset;
+		view->seek_forward(segment, offset);
+		return *this;
+	}
+	auto segmented_view::const_iter::operator++(int) -> const_iter {
+		auto copy = *this;
+		++*this;
+		return copy;
+	}
+	auto segmented_view::const_iter::operator--() -> const_iter& {
+		view->seek_backward(segment, offset);
+		return *this;
+	}
+	auto segmented_view::const_iter::operator--(int) -> const_iter {
+		auto copy = *this;
+		--*this;
+		return copy;
+	}
+
+	segmented_view::segmented_view()
+	: parts()
+	, raw_ends()
+	, accepted_ends()
+	, pred(default_predicate) {}
+	segmented_view::segmented_view(std::vector<std::string_view> segments, filter predicate)
+	: parts(std::move(segments))
+	, raw_ends()
+	, accepted_ends()
+	, pred(std::move(predicate)) {
+		std::erase_if(parts, [](std::string_view part) {
+			return part.empty();
+		});
+		measure();
+	}
+	segmented_view::segmented_view(std::span<const ::iovec> segments, filter predicate)
+	: segmented_view(to_parts(segments), std::move(predicate)) {}
+	auto segmented_view::ring(const char* storage,
+	                          std::size_t capacity,
+	                          std::size_t head,
+	                          std::size_t length,
+	                          filter predicate) -> segmented_view {
+		if (length > capacity or (length != 0 and head >= capacity)) {
+			throw std::domain_error("segmented_view::ring: " + std::to_string(length) + " bytes from "
+			                        + std::to_string(head) + " do not fit a ring of " + std::to_string(capacity));
+		}
+		if (length == 0) {
+			return segmented_view(std::vector<std::string_view>(), std::move(predicate));
+		}
+		const auto first = std::min(length, capacity - head);
+		return segmented_view({std::string_view(storage + head, first), std::string_view(storage, length - first)},
+		                      std::move(predicate));
+	}
+	auto segmented_view::measure() -> void {
+		raw_ends.clear();
+		accepted_ends.clear();
+		auto raw = std::size_t{0};
+		auto accepted = std::size_t{0};
+		for (const auto part : parts) {
+			detail::for_each_block(part.data(), part.size(), pred, [&accepted](std::size_t, std::uint64_t bits) {
+				accepted += detail::popcount(bits);
+				return true;
+			});
+			raw_ends.push_back(raw += part.size());
+			accepted_ends.push_back(accepted);
+		}
+	}
+	// Segments without accepted bytes are skipped using the counts measure() recorded.
+	auto segmented_view::seek_forward(std::size_t& segment, std::size_t& offset) const -> void {
+		while (segment < parts.size()) {
+			const auto before = segment == 0 ? 0 : accepted_ends[segment - 1];
+			if (offset >= parts[segment].size() or accepted_ends[segment] == before) {
+				++segment;
+				offset = 0;
+			}
+			else if (pred(parts[segment][offset])) {
+				return;
+			}
+			else {
+				++offset;
+			}
+		}
+		offset = 0;
+	}
+	auto segmented_view::seek_backward(std::size_t& segment, std::size_t& offset) const -> void {
+		while (segment > 0 or offset > 0) {
+			if (offset == 0) {
+				--segment;
+				offset = parts[segment].size();
+			}
+			else if (pred(parts[segment][--offset])) {
+				return;
+			}
+		}
+	}
+	auto segmented_view::slice(std::size_t raw_from, std::size_t raw_to) const -> segmented_view {
+		auto result = segmented_view();
+		result.pred = pred;
+		for (std::size_t i = 0; i < parts.size(); ++i) {
+			const auto start = i == 0 ? 0 : raw_ends[i - 1];
+			const auto from = std::max(raw_from, start);
+			const auto to = std::min(raw_to, raw_ends[i]);
+			if (from < to) {
+				result.parts.push_back(parts[i].substr(from - start, to - from));
+			}
+		}
+		result.measure();
+		return result;
+	}
+	auto segmented_view::at(std::size_t n) const -> const char& {
+		if (n >= size()) {
+			throw std::domain_error("segmented_view::at(" + std::to_string(n) + "): invalid index");
+		}
+		const auto found_end = std::upper_bound(accepted_ends.begin(), accepted_ends.end(), n);
+		const auto segment = static_cast<std::size_t>(found_end - accepted_ends.begin());
+		const auto part = parts[segment];
+		auto remaining = n - (segment == 0 ? 0 : accepted_ends[segment - 1]);
+		auto found = std::size_t{0};
+		detail::for_each_block(part.data(), part.size(), pred, [&](std::size_t offset, std::uint64_t bits) {
+			if (const auto accepted = detail::popcount(bits); remaining >= accepted) {
+				remaining -= accepted;
+				return true;
+			}
+			found = offset + detail::select_bit(bits, remaining);
+			return false;
+		});
+		return part.data()[found];
+	}
+	auto segmented_view::operator[](std::size_t n) const -> const char& {
+		return at(n);
+	}
+	auto segmented_view::size() const noexcept -> std::size_t {
+		return accepted_ends.empty() ? 0 : accepted_ends.back();
+	}
+	auto segmented_view::empty() const noexcept -> bool {
+		return size() == 0;
+	}
+	auto segmented_view::segments() const noexcept -> std::span<const std::string_view> {
+		return parts;
+	}
+	auto segmented_view::predicate() const noexcept -> const filter& {
+		return pred;
+	}
+	segmented_view::operator std::string() const {
+		auto result = std::string();
+		result.reserve(size());
+		std::copy(begin(), end(), std::back_inserter(result));
+		return result;
+	}
+	auto segmented_view::begin() const -> iterator {
+		auto segment = std::size_t{0};
+		auto offset = std::size_t{0};
+		seek_forward(segment, offset);
+		return iterator(this, segment, offset);
+	}
+	auto segmented_view::end() const -> iterator {
+		return iterator(this, parts.size(), 0);
+	}
+	auto segmented_view::rbegin() const -> reverse_iterator {
+		return reverse_iterator(end());
+	}
+	auto segmented_view::rend() const -> reverse_iterator {
+		return reverse_iterator(begin());
+	}
+	auto segmented_view::cbegin() const -> const_iterator {
+		return begin();
+	}
+	auto segmented_view::cend() const -> const_iterator {
+		return end();
+	}
+	auto segmented_view::crbegin() const -> const_reverse_iterator {
+		return rbegin();
+	}
+	auto segmented_view::crend() const -> const_reverse_iterator {
+		return rend();
+	}
+
+	auto operator==(const segmented_view& lhs, const segmented_view& rhs) -> bool {
+		return lhs.size() == rhs.size() and std::equal(lhs.begin(), lhs.end(), rhs.begin());
+	}
+	auto operator<=>(const segmented_view& lhs, const segmented_view& rhs) -> std::strong_ordering {
+		return std::lexicographical_compare_three_way(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+	}
+	auto operator<<(std::ostream& os, const segmented_view& view) -> std::ostream& {
+		for (const auto part : view.parts) {
+			detail::for_each_block(part.data(), part.size(), view.pred, [&](std::size_t offset, std::uint64_t bits) {
+				for (; bits != 0; bits &= bits - 1) {
+					os.put(part[offset + static_cast<std::size_t>(std::countr_zero(bits))]);
+				}
+				return true;
+			});
+		}
+		return os;
+	}
+	// Pieces are cut from the raw offsets of the concatenated segments, so a piece or a delimiter may
+	// span several segments.
+	auto split(const segmented_view& view, const filtered_string_view& tok) -> std::vector<segmented_view> {
+		std::vector<segmented_view> result;
+		auto search = detail::delimiter_search(static_cast<std::string>(tok));
+		if (search.empty()) {
+			result.push_back(view);
+			return result;
+		}
+		auto raw_from = std::size_t{0};
+		for (std::size_t i = 0; i < view.parts.size(); ++i) {
+			const auto part = view.parts[i];
+			const auto start = i == 0 ? 0 : view.raw_ends[i - 1];
+			detail::for_each_block(part.data(), part.size(), view.pred, [&](std::size_t offset, std::uint64_t bits) {
+				for (; bits != 0; bits &= bits - 1) {
+					const auto at = offset + static_cast<std::size_t>(std::countr_zero(bits));
+					if (search.feed(part[at], start + at + 1)) {
+						result.push_back(view.slice(raw_from, search.piece_end()));
+						raw_from = search.match_end();
+					}
+				}
+				return true;
+			});
+		}
+		if (search.too_short()) {
+			result.push_back(view);
+			return result;
+		}
+		result.push_back(view.slice(raw_from, search.match_end()));
+		return result;
+	}
+} // namespace fsv
@@ -0,0 +1,100 @@
+#ifndef COMP6771_ASS2_SEGMENTED_VIEW_H
+#define COMP6771_ASS2_SEGMENTED_VIEW_H
+
+#include "./filtered_string_view.h"
+
+#include <compare>
+#include <cstddef>
+#include <iostream>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <vector>
+
+namespace fsv {
+	// A filtered view over text held in several separate buffers, such as a chain of fixed-size
+	// blocks, an iovec array or the two halves of a wrapped ring buffer, read in place as if they
+	// were one string. Only the list of segments is copied; the bytes are borrowed.
+	class segmented_view {
+		class const_iter {
+		 public:
+			using iterator_category = std::bidirectional_iterator_tag;
+			using value_type = char;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const char*;
+			using reference = const char&;
+			const_iter() noexcept;
+			const_iter(const segmented_view* view, std::size_t segment, std::size_t offset) noexcept;
+			auto operator*() const -> reference;
+			auto operator->() const -> pointer;
+			auto operator++() -> const_iter&;
+			auto operator++(int) -> const_iter;
+			auto operator--() -> const_iter&;
+			auto operator--(int) -> const_iter;
+			friend auto operator==(const const_iter& lhs, const const_iter& rhs) -> bool {
+				return lhs.view == rhs.view and lhs.segment == rhs.segment and lhs.offset == rhs.offset;
+			}
+			friend auto operator!=(const const_iter& lhs, const const_iter& rhs) -> bool {
+				return !(lhs == rhs);
+			}
+
+		 private:
+			const segmented_view* view;
+			std::size_t segment;
+			std::size_t offset;
+		};
+
+	 public:
+		segmented_view();
+		explicit segmented_view(std::vector<std::string_view> segments, filter predicate = default_predicate);
+		explicit segmented_view(std::span<const ::iovec> segments, filter predicate = default_predicate);
+		// The length bytes of a ring of capacity bytes that start at head, wrapping to the front.
+		[[nodiscard]] static auto ring(const char* storage,
+		                               std::size_t capacity,
+		                               std::size_t head,
+		                               std::size_t length,
+		                               filter predicate = default_predicate) -> segmented_view;
+		[[nodiscard]] auto at(std::size_t n) const -> const char&;
+		[[nodiscard]] auto operator[](std::size_t n) const -> const char&;
+		[[nodiscard]] auto size() const noexcept -> std::size_t;
+		[[nodiscard]] auto empty() const noexcept -> bool;
+		[[nodiscard]] auto segments() const noexcept -> std::span<const std::string_view>;
+		[[nodiscard]] auto predicate() const noexcept -> const filter&;
+		explicit operator std::string() const;
+		using iterator = const_iter;
+		using const_iterator = const_iter;
+		using reverse_iterator = std::reverse_iterator<iterator>;
+		using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+		auto begin() const -> iterator;
+		auto end() const -> iterator;
+		auto rbegin() const -> reverse_iterator;
+		auto rend() const -> reverse_iterator;
+		auto cbegin() const -> const_iterator;
+		auto cend() const -> const_iterator;
+		auto crbegin() const -> const_reverse_iterator;
+		auto crend() const -> const_reverse_iterator;
+
+	 private:
+		friend auto operator<<(std::ostream& os, const segmented_view& view) -> std::ostream&;
+		friend auto split(const segmented_view& view, const filtered_string_view& tok) -> std::vector<segmented_view>;
+		// Classifies every segment once, recording the running raw and accepted counts.
+		auto measure() -> void;
+		auto seek_forward(std::size_t& segment, std::size_t& offset) const -> void;
+		auto seek_backward(std::size_t& segment, std::size_t& offset) const -> void;
+		// The bytes from raw_from to raw_to of the concatenated segments, with the same predicate.
+		[[nodiscard]] auto slice(std::size_t raw_from, std::size_t raw_to) const -> segmented_view;
+		std::vector<std::string_view> parts;
+		std::vector<std::size_t> raw_ends;
+		std::vector<std::size_t> accepted_ends;
+		filter pred;
+	};
+	[[nodiscard]] auto operator==(const segmented_view& lhs, const segmented_view& rhs) -> bool;
+	[[nodiscard]] auto operator<=>(const segmented_view& lhs, const segmented_view& rhs) -> std::strong_ordering;
+	auto operator<<(std::ostream& os, const segmented_view& view) -> std::ostream&;
+	[[nodiscard]] auto split(const segmented_view& view, const filtered_string_view& tok)
+	    -> std::vector<segmented_view>;
+} // namespace fsv
+
+#endif // COMP6771_ASS2_SEGMENTED_VIEW_H
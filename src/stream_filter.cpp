@@ -0,0 +1,111 @@
+#include "./stream_filter.h"
+#include "./acceptance_index.h"
+#include "./delimiter_search.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <unistd.h>
+
+namespace fsv {
+	namespace {
+		auto istream_source(std::istream& in) {
+			return [&in](char* out, std::size_t n) {
+				in.read(out, static_cast<std::streamsize>(n));
+				if (in.bad()) {
+					throw std::runtime_error("fsv::stream_filter: cannot read stream");
+				}
+				return static_cast<std::size_t>(in.gcount());
+			};
+		}
+		auto fd_source(int fd) {
+			return [fd](char* out, std::size_t n) {
+				for (;;) {
+					if (const auto got = ::read(fd, out, n); got >= 0) {
+						return static_cast<std::size_t>(got);
+					}
+					if (errno != EINTR) {
+						throw std::system_error(errno, std::generic_category(), "fsv::stream_filter: cannot read");
+					}
+				}
+			};
+		}
+	} // namespace
+
+	stream_filter::stream_filter(filter predicate, std::size_t chunk_size)
+	: pred(std::move(predicate))
+	, chunk_size(chunk_size)
+	, buffer() {
+		if (chunk_size == 0) {
+			throw std::invalid_argument("fsv::stream_filter: chunk size must be positive");
+		}
+	}
+	auto stream_filter::for_each_chunk(std::istream& in, const sink& chunk_sink) -> std::size_t {
+		return read_chunks(istream_source(in), chunk_sink);
+	}
+	auto stream_filter::for_each_chunk(int fd, const sink& chunk_sink) -> std::size_t {
+		return read_chunks(fd_source(fd), chunk_sink);
+	}
+	auto stream_filter::split(std::istream& in, const filtered_string_view& tok, const sink& piece_sink)
+	    -> std::size_t {
+		return split_chunks(istream_source(in), static_cast<std::string>(tok), piece_sink);
+	}
+	auto stream_filter::split(int fd, const filtered_string_view& tok, const sink& piece_sink) -> std::size_t {
+		return split_chunks(fd_source(fd), static_cast<std::string>(tok), piece_sink);
+	}
+	auto stream_filter::read_chunks(const source& read, const sink& chunk_sink) -> std::size_t {
+		buffer.resize(std::max(buffer.size(), chunk_size));
+		auto total = std::size_t{0};
+		for (auto n = read(buffer.data(), chunk_size); n != 0; n = read(buffer.data(), chunk_size)) {
+			total += n;
+			chunk_sink(filtered_string_view(buffer.data(), n, pred));
+		}
+		return total;
+	}
+	// After each chunk the unfinished piece is moved to the front of the buffer, and the offsets the
+	// search remembers move with it.
+	auto stream_filter::split_chunks(const source& read, const std::string& delimiter, const sink& piece_sink)
+	    -> std::size_t {
+		auto search = detail::delimiter_search(delimiter);
+		const auto scan = detail::scanner(pred);
+		auto total = std::size_t{0};
+		auto begin = std::size_t{0};
+		auto filled = std::size_t{0};
+		for (;;) {
+			buffer.resize(std::max(buffer.size(), filled + chunk_size));
+			const auto n = read(buffer.data() + filled, chunk_size);
+			if (n == 0) {
+				break;
+			}
+			total += n;
+			const auto* data = buffer.data();
+			for (auto offset = filled; offset < filled + n and not search.empty(); offset += detail::block_size) {
+				const auto length = std::min(detail::block_size, filled + n - offset);
+				for (auto bits = scan.mask(data + offset, length); bits != 0; bits &= bits - 1) {
+					const auto at = offset + static_cast<std::size_t>(std::countr_zero(bits));
+					if (search.feed(data[at], at + 1)) {
+						piece_sink(filtered_string_view(data + begin, search.piece_end() - begin, pred));
+						begin = search.match_end();
+					}
+				}
+			}
+			filled += n;
+			if (begin != 0) {
+				std::memmove(buffer.data(), buffer.data() + begin, filled - begin);
+				filled -= begin;
+				search.shift(begin);
+				begin = 0;
+			}
+		}
+		if (search.too_short()) {
+			piece_sink(filtered_string_view(buffer.data(), filled, pred));
+		}
+		else {
+			piece_sink(filtered_string_view(buffer.data() + begin, search.match_end() - begin, pred));
+		}
+		return total;
+	}
+} // namespace fsv
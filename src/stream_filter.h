@@ -0,0 +1,41 @@
+#ifndef COMP6771_ASS2_STREAM_FILTER_H
+#define COMP6771_ASS2_STREAM_FILTER_H
+
+#include "./filtered_string_view.h"
+
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace fsv {
+	// Filters inputs that cannot be mapped, such as pipes and standard input, a fixed-size chunk at a
+	// time through one reused buffer. The views handed to a sink point into that buffer and are only
+	// valid for the duration of the call.
+	class stream_filter {
+	 public:
+		using sink = std::function<void(const filtered_string_view&)>;
+		static constexpr auto default_chunk_size = std::size_t{1} << 16;
+
+		explicit stream_filter(filter predicate = default_predicate, std::size_t chunk_size = default_chunk_size);
+		// Calls chunk_sink with a view of each chunk as it is read. Returns the number of bytes read.
+		auto for_each_chunk(std::istream& in, const sink& chunk_sink) -> std::size_t;
+		auto for_each_chunk(int fd, const sink& chunk_sink) -> std::size_t;
+		// Calls piece_sink with each piece that split() would return for a view of the whole input,
+		// carrying a piece or delimiter that straddles two chunks over into the next read. The buffer
+		// holds the longest piece plus one chunk, so with an empty delimiter it holds the whole input.
+		auto split(std::istream& in, const filtered_string_view& tok, const sink& piece_sink) -> std::size_t;
+		auto split(int fd, const filtered_string_view& tok, const sink& piece_sink) -> std::size_t;
+
+	 private:
+		using source = std::function<std::size_t(char*, std::size_t)>;
+		auto read_chunks(const source& read, const sink& chunk_sink) -> std::size_t;
+		auto split_chunks(const source& read, const std::string& delimiter, const sink& piece_sink) -> std::size_t;
+		filter pred;
+		std::size_t chunk_size;
+		std::vector<char> buffer;
+	};
+} // namespace fsv
+
+#endif // COMP6771_ASS2_STREAM_FILTER_H
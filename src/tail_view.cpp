@@ -0,0 +1,92 @@
+#include "./tail_view.h"
+#include "./acceptance_index.h"
+
+#include <bit>
+#include <stdexcept>
+#include <utility>
+
+namespace fsv {
+	tail_view::tail_view(filter predicate, const filtered_string_view& tok)
+	: pred(std::move(predicate))
+	, search(static_cast<std::string>(tok))
+	, index(std::make_shared<detail::acceptance_index>(0))
+	, ptr("")
+	, pending()
+	, piece_start(0) {}
+	tail_view::tail_view(tail_view&& other)
+	: pred(other.pred)
+	, search(other.search)
+	, index(std::exchange(other.index, std::make_shared<detail::acceptance_index>(0)))
+	, ptr(std::exchange(other.ptr, ""))
+	, pending(std::exchange(other.pending, {}))
+	, piece_start(std::exchange(other.piece_start, 0)) {
+		other.search.reset();
+	}
+	auto tail_view::operator=(tail_view&& other) -> tail_view& {
+		if (this != &other) {
+			pred = other.pred;
+			search = other.search;
+			index = std::exchange(other.index, std::make_shared<detail::acceptance_index>(0));
+			ptr = std::exchange(other.ptr, "");
+			pending = std::exchange(other.pending, {});
+			piece_start = std::exchange(other.piece_start, 0);
+			other.search.reset();
+		}
+		return *this;
+	}
+	// The new bytes are classified once, by the index; the search then reads them back from it.
+	auto tail_view::extend(const char* data, std::size_t length) -> void {
+		const auto from = index->length();
+		if (length < from) {
+			throw std::domain_error("tail_view::extend(" + std::to_string(length) + "): the buffer cannot shrink");
+		}
+		index->extend(data, pred, length);
+		ptr = data;
+		if (search.empty()) {
+			return;
+		}
+		for (auto offset = from; offset < length; offset += detail::block_size) {
+			for (auto bits = index->word_at(offset) & detail::low_bits(length - offset); bits != 0; bits &= bits - 1) {
+				const auto at = offset + static_cast<std::size_t>(std::countr_zero(bits));
+				if (search.feed(data[at], at + 1)) {
+					pending.emplace_back(piece_start, search.piece_end());
+					piece_start = search.match_end();
+				}
+			}
+		}
+	}
+	auto tail_view::shrink_to_fit() -> void {
+		index->finish();
+	}
+	auto tail_view::size() const noexcept -> std::size_t {
+		return index->count();
+	}
+	auto tail_view::length() const noexcept -> std::size_t {
+		return index->length();
+	}
+	auto tail_view::view() const -> filtered_string_view {
+		auto shared = std::shared_ptr<const detail::acceptance_index>(index);
+		auto state = std::make_shared<const detail::view_state>(pred, std::move(shared));
+		state->publish_size(index->count());
+		return filtered_string_view(ptr, index->length(), std::move(state));
+	}
+	auto tail_view::take_pieces() -> std::vector<filtered_string_view> {
+		auto pieces = std::vector<filtered_string_view>();
+		if (pending.empty()) {
+			return pieces;
+		}
+		const auto whole = view();
+		pieces.reserve(pending.size());
+		for (const auto& [from, to] : pending) {
+			pieces.push_back(whole.slice(from, to));
+		}
+		pending.clear();
+		return pieces;
+	}
+	auto tail_view::rest() const -> filtered_string_view {
+		if (search.too_short()) {
+			return view();
+		}
+		return view().slice(piece_start, search.match_end());
+	}
+} // namespace fsv
@@ -0,0 +1,60 @@
+#ifndef COMP6771_ASS2_TAIL_VIEW_H
+#define COMP6771_ASS2_TAIL_VIEW_H
+
+#include "./delimiter_search.h"
+#include "./filtered_string_view.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fsv {
+	namespace detail {
+		class acceptance_index;
+	} // namespace detail
+
+	// A filtered view of a buffer that only grows at the end, such as a log being tailed. Each
+	// extend() classifies and indexes just the bytes appended since the last one, and carries the
+	// count, the index and the search for the delimiter over, so an append costs time in proportion
+	// to the bytes appended rather than to the whole buffer.
+	//
+	// The views handed out share the tail_view's index, so they must not be read while extend() runs
+	// on another thread. A tail_view grows its index in place, so it can be moved but not copied; a
+	// moved-from tail_view is empty, as if just constructed with the same predicate and delimiter.
+	class tail_view {
+	 public:
+		explicit tail_view(filter predicate = default_predicate, const filtered_string_view& tok = "\n");
+		tail_view(const tail_view&) = delete;
+		tail_view(tail_view&& other);
+		auto operator=(const tail_view&) -> tail_view& = delete;
+		auto operator=(tail_view&& other) -> tail_view&;
+		~tail_view() = default;
+		// data may move between calls, as when a std::string reallocates, but the bytes seen before
+		// must be unchanged.
+		auto extend(const char* data, std::size_t length) -> void;
+		// Packs the index's partial last chunk, which extend() keeps as a plain bitmap, into its
+		// smallest form. The next extend() reopens it.
+		auto shrink_to_fit() -> void;
+		[[nodiscard]] auto size() const noexcept -> std::size_t;
+		[[nodiscard]] auto length() const noexcept -> std::size_t;
+		// The whole buffer so far, with its size and index already known.
+		[[nodiscard]] auto view() const -> filtered_string_view;
+		// The pieces of split(view(), tok) that have been closed by a delimiter since the last call.
+		[[nodiscard]] auto take_pieces() -> std::vector<filtered_string_view>;
+		// The last piece of split(view(), tok), which later bytes may still extend.
+		[[nodiscard]] auto rest() const -> filtered_string_view;
+
+	 private:
+		filter pred;
+		detail::delimiter_search search;
+		std::shared_ptr<detail::acceptance_index> index;
+		const char* ptr;
+		// Raw ranges of the closed pieces not yet taken, and where the open piece starts.
+		std::vector<std::pair<std::size_t, std::size_t>> pending;
+		std::size_t piece_start;
+	};
+} // namespace fsv
+
+#endif // COMP6771_ASS2_TAIL_VIEW_H
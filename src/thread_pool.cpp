@@ -0,0 +1,187 @@
+#include "./thread_pool.h"
+
+#include <utility>
+
+namespace fsv {
+	namespace {
+		// The pool and the index of the worker the calling thread is, if it is one.
+		struct worker_identity {
+			const thread_pool* pool;
+			std::size_t index;
+		};
+		thread_local auto current_worker = worker_identity{nullptr, 0};
+	} // namespace
+
+	thread_pool::thread_pool(unsigned threads)
+	: queues()
+	, injected()
+	, queued(0)
+	, sleep_lock()
+	, wake()
+	, workers() {
+		for (unsigned i = 1; i < threads; ++i) {
+			queues.push_back(std::make_unique<worker_queue>());
+		}
+		for (std::size_t i = 0; i < queues.size(); ++i) {
+			workers.emplace_back([this, i](std::stop_token stop) { work(i, std::move(stop)); });
+		}
+	}
+	thread_pool::~thread_pool() = default;
+	auto thread_pool::size() const noexcept -> std::size_t {
+		return workers.size() + 1;
+	}
+	auto thread_pool::parallel_for(std::size_t count, const std::function<void(std::size_t)>& body) -> void {
+		if (count == 0) {
+			return;
+		}
+		if (count == 1 or workers.empty()) {
+			for (std::size_t i = 0; i < count; ++i) {
+				body(i);
+			}
+			return;
+		}
+		const auto grain = std::max(std::size_t{1}, count / (8 * size()));
+		auto group = task_group(*this);
+		auto split = std::function<void(std::size_t, std::size_t)>();
+		split = [&](std::size_t from, std::size_t to) {
+			while (to - from > grain) {
+				const auto mid = from + (to - from) / 2;
+				group.run([&split, mid, to] { split(mid, to); });
+				to = mid;
+			}
+			for (; from < to; ++from) {
+				body(from);
+			}
+		};
+		group.run([&split, count] { split(0, count); });
+		group.wait();
+	}
+	auto thread_pool::shared() -> thread_pool& {
+		static auto pool = thread_pool();
+		return pool;
+	}
+	auto thread_pool::push(job task) -> void {
+		auto& queue = current_worker.pool == this ? *queues[current_worker.index] : injected;
+		queued.fetch_add(1, std::memory_order_release);
+		{
+			const auto guard = std::lock_guard(queue.lock);
+			queue.jobs.push_back(std::move(task));
+		}
+		// Taking the lock orders this wake after any worker's last look at queued.
+		{
+			const auto guard = std::lock_guard(sleep_lock);
+		}
+		wake.notify_one();
+	}
+	// A worker looks in its own deque first, newest task first, then in the injection queue, then
+	// steals the oldest task of the next worker along that has one.
+	auto thread_pool::take() -> std::optional<job> {
+		const auto own = current_worker.pool == this;
+		const auto start = own ? current_worker.index : 0;
+		const auto pop = [this](worker_queue& queue, bool newest) -> std::optional<job> {
+			const auto guard = std::lock_guard(queue.lock);
+			if (queue.jobs.empty()) {
+				return std::nullopt;
+			}
+			auto task = std::move(newest ? queue.jobs.back() : queue.jobs.front());
+			if (newest) {
+				queue.jobs.pop_back();
+			}
+			else {
+				queue.jobs.pop_front();
+			}
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			return task;
+		};
+		if (own) {
+			if (auto task = pop(*queues[start], true)) {
+				return task;
+			}
+		}
+		if (auto task = pop(injected, false)) {
+			return task;
+		}
+		for (std::size_t i = 0; i < queues.size(); ++i) {
+			if (auto task = pop(*queues[(start + i) % queues.size()], false)) {
+				return task;
+			}
+		}
+		return std::nullopt;
+	}
+	auto thread_pool::run_one() -> bool {
+		auto task = take();
+		if (not task) {
+			return false;
+		}
+		auto thrown = std::exception_ptr();
+		try {
+			task->fn();
+		} catch (...) {
+			thrown = std::current_exception();
+		}
+		task->group->finish(std::move(thrown));
+		return true;
+	}
+	auto thread_pool::work(std::size_t index, std::stop_token stop) -> void {
+		current_worker = worker_identity{this, index};
+		while (not stop.stop_requested()) {
+			if (run_one()) {
+				continue;
+			}
+			auto guard = std::unique_lock(sleep_lock);
+			static_cast<void>(wake.wait(guard, stop, [this] { return queued.load(std::memory_order_acquire) > 0; }));
+		}
+	}
+
+	task_group::task_group(thread_pool& pool) noexcept
+	: pool(&pool)
+	, pending(0)
+	, spawned(0)
+	, lock()
+	, done()
+	, error() {}
+	task_group::~task_group() {
+		join();
+	}
+	auto task_group::run(std::function<void()> fn) -> void {
+		pending.fetch_add(1, std::memory_order_relaxed);
+		pool->push(thread_pool::job{std::move(fn), this});
+		{
+			const auto guard = std::lock_guard(lock);
+			spawned.fetch_add(1, std::memory_order_release);
+		}
+		done.notify_all();
+	}
+	auto task_group::wait() -> void {
+		join();
+		if (auto thrown = std::exchange(error, nullptr)) {
+			std::rethrow_exception(thrown);
+		}
+	}
+	// The joining thread keeps taking queued tasks until the group is done. When there are none, it
+	// sleeps until the last task finishes or a running task queues another, which it then helps
+	// with rather than leaving it to the workers.
+	auto task_group::join() noexcept -> void {
+		while (pending.load(std::memory_order_acquire) > 0) {
+			const auto seen = spawned.load(std::memory_order_acquire);
+			if (pool->run_one()) {
+				continue;
+			}
+			auto guard = std::unique_lock(lock);
+			done.wait(guard, [this, seen] {
+				return pending.load(std::memory_order_acquire) == 0 or spawned.load(std::memory_order_acquire) != seen;
+			});
+		}
+		// The last task to finish may still hold the lock, and the group must outlive it.
+		const auto guard = std::lock_guard(lock);
+	}
+	auto task_group::finish(std::exception_ptr thrown) noexcept -> void {
+		const auto guard = std::lock_guard(lock);
+		if (thrown and not error) {
+			error = std::move(thrown);
+		}
+		if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			done.notify_all();
+		}
+	}
+} // namespace fsv
@@ -0,0 +1,96 @@
+#ifndef COMP6771_ASS2_THREAD_POOL_H
+#define COMP6771_ASS2_THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace fsv {
+	class task_group;
+
+	// A work-stealing pool of worker threads for the parallel operations. Each worker has its own
+	// deque: tasks a worker queues go on its back and it takes them back last in, first out, while
+	// idle workers steal from the front of the others'. Tasks queued from outside the pool go on a
+	// shared injection queue. A thread waiting for tasks runs queued ones meanwhile, so nested
+	// parallel loops never deadlock, even on a pool of one thread.
+	class thread_pool {
+	 public:
+		// threads counts the thread waiting for the work, so a pool of one thread starts no workers and
+		// runs everything on the waiting thread.
+		explicit thread_pool(unsigned threads = std::max(1U, std::thread::hardware_concurrency()));
+		thread_pool(const thread_pool&) = delete;
+		auto operator=(const thread_pool&) -> thread_pool& = delete;
+		~thread_pool();
+		[[nodiscard]] auto size() const noexcept -> std::size_t;
+		// Calls body(i) once for each i below count and returns when every call has. The range is
+		// halved into tasks until the pieces are small enough to keep every thread busy. If calls
+		// throw, the first exception is rethrown once the rest have finished.
+		auto parallel_for(std::size_t count, const std::function<void(std::size_t)>& body) -> void;
+		// The pool used when no other is given, with one thread per core.
+		[[nodiscard]] static auto shared() -> thread_pool&;
+
+	 private:
+		friend class task_group;
+		struct job {
+			std::function<void()> fn;
+			task_group* group;
+		};
+		struct worker_queue {
+			std::mutex lock;
+			std::deque<job> jobs;
+		};
+
+		auto push(job task) -> void;
+		// Runs one queued task if any thread has one, and returns whether it did.
+		auto run_one() -> bool;
+		[[nodiscard]] auto take() -> std::optional<job>;
+		auto work(std::size_t index, std::stop_token stop) -> void;
+
+		std::vector<std::unique_ptr<worker_queue>> queues;
+		worker_queue injected;
+		// Tasks queued and not yet taken, which idle workers sleep on.
+		std::atomic<std::size_t> queued;
+		std::mutex sleep_lock;
+		std::condition_variable_any wake;
+		std::vector<std::jthread> workers;
+	};
+
+	// Fork-join on a thread pool: run() queues tasks and wait() returns once all of them have
+	// finished, running queued tasks itself in the meantime.
+	class task_group {
+	 public:
+		explicit task_group(thread_pool& pool = thread_pool::shared()) noexcept;
+		task_group(const task_group&) = delete;
+		auto operator=(const task_group&) -> task_group& = delete;
+		// Waits for the tasks still running, dropping any exception they threw.
+		~task_group();
+		auto run(std::function<void()> fn) -> void;
+		// Rethrows the first exception a task threw.
+		auto wait() -> void;
+
+	 private:
+		friend class thread_pool;
+		auto join() noexcept -> void;
+		auto finish(std::exception_ptr thrown) noexcept -> void;
+
+		thread_pool* pool;
+		std::atomic<std::size_t> pending;
+		// Tasks run() has queued so far, bumped under lock so that a joining thread waiting on done
+		// wakes to take them.
+		std::atomic<std::size_t> spawned;
+		std::mutex lock;
+		std::condition_variable done;
+		std::exception_ptr error;
+	};
+} // namespace fsv
+
+#endif // COMP6771_ASS2_THREAD_POOL_H